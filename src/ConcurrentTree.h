@@ -0,0 +1,176 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "FileItem.h"
+
+// Epoch-based reclamation, one domain per process. A reader announces the global epoch in
+// its thread's slot for as long as it holds a version; a version retired at epoch e may be
+// freed once no slot announces an epoch <= e.
+class EpochDomain
+{
+public:
+    static constexpr std::size_t kMaxThreads = 256;
+    static constexpr std::uint64_t kInactive = 0;
+private:
+    struct alignas(64) Slot
+    {
+        std::atomic<std::uint64_t>  epoch{kInactive};
+        std::atomic<bool>           owned{false};
+    };
+    // One per thread; gives the slot back when the thread exits.
+    struct ThreadSlot
+    {
+        Slot*   slot{nullptr};
+        int     depth{0};
+        ~ThreadSlot() { if (slot) slot->owned.store(false, std::memory_order_release); }
+    };
+
+    EpochDomain() = default;
+    ThreadSlot& LocalSlot()
+    {
+        thread_local ThreadSlot local;
+        if (!local.slot)
+        {
+            for (Slot& slot : m_slots)
+                if (!slot.owned.exchange(true, std::memory_order_acq_rel))
+                {
+                    local.slot = &slot;
+                    return local;
+                }
+            throw std::runtime_error("EpochDomain: too many reader threads");
+        }
+        return local;
+    }
+
+    std::atomic<std::uint64_t>  m_epoch{1};
+    Slot                        m_slots[kMaxThreads];
+public:
+    static EpochDomain& Global()
+    {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    // Pins the calling thread for the guard's lifetime. Guards nest; only the outermost one
+    // announces an epoch.
+    class Guard
+    {
+        ThreadSlot& m_slot;
+    public:
+        explicit Guard(EpochDomain& domain = Global()) : m_slot(domain.LocalSlot())
+        {
+            if (m_slot.depth++ == 0)
+                m_slot.slot->epoch.store(domain.m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        }
+        ~Guard()
+        {
+            if (--m_slot.depth == 0)
+                m_slot.slot->epoch.store(kInactive, std::memory_order_release);
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    // Ends the current epoch and returns it; call after unpublishing the object to retire.
+    std::uint64_t Advance() { return m_epoch.fetch_add(1, std::memory_order_seq_cst); }
+    // The oldest epoch any reader may still be in, or the current one if none is pinned.
+    std::uint64_t OldestPinned() const
+    {
+        std::uint64_t oldest = m_epoch.load(std::memory_order_seq_cst);
+        for (const Slot& slot : m_slots)
+        {
+            const std::uint64_t epoch = slot.epoch.load(std::memory_order_seq_cst);
+            if (epoch != kInactive && epoch < oldest)
+                oldest = epoch;
+        }
+        return oldest;
+    }
+};
+
+// A FileItem shared between many reader threads and a few writers. Readers take no locks:
+// Read() pins an epoch and hands fn the current version. Writers are serialized; Update()
+// applies fn to a copy of the current version, which thanks to the shared children costs
+// only the spine it touches, and publishes it with one atomic store. Replaced versions are
+// freed once every reader that could see them has finished.
+//
+// Versions are immutable once published, so readers may use every const operation except
+// those that fill caches lazily: Find() on large containers and Aggregates(). A writer can
+// fill them from inside Update() before the version is published. Keep the tree in the
+// default resource: copies of an arena tree are deep.
+class ConcurrentTree
+{
+public:
+    explicit ConcurrentTree(FileItem root)
+        : m_domain(EpochDomain::Global()), m_current(new FileItem(std::move(root))) {}
+    ConcurrentTree(const ConcurrentTree&) = delete;
+    ConcurrentTree& operator=(const ConcurrentTree&) = delete;
+    // No reader may still be inside Read().
+    ~ConcurrentTree() { delete m_current.load(std::memory_order_relaxed); }
+
+    // Calls fn(const FileItem& root) on the current version and returns its result. The
+    // reference must not escape fn; take a Snapshot() to keep a version.
+    template<class Fn>
+    decltype(auto) Read(Fn&& fn) const
+    {
+        EpochDomain::Guard guard(m_domain);
+        return std::forward<Fn>(fn)(std::as_const(*m_current.load(std::memory_order_seq_cst)));
+    }
+    // An O(1) private copy of the current version.
+    FileItem Snapshot() const
+    {
+        return Read([](const FileItem& root) { return root; });
+    }
+
+    // Calls fn(FileItem& root) on a copy of the current version and publishes the result.
+    // If fn throws, nothing is published and the exception propagates.
+    template<class Fn>
+    void Update(Fn&& fn)
+    {
+        std::lock_guard lock(m_writer);
+        auto next = std::make_unique<FileItem>(*m_current.load(std::memory_order_relaxed));
+        std::forward<Fn>(fn)(*next);
+        const FileItem* previous = m_current.exchange(next.release(), std::memory_order_seq_cst);
+        m_retired.push_back(Retired{m_domain.Advance(), std::unique_ptr<const FileItem>(previous)});
+        ReclaimLocked();
+    }
+    void Rename(const Path& path, std::string_view new_name)
+    {
+        Update([&path, new_name](FileItem& root) { root[path].Rename(new_name); });
+    }
+
+    // Frees the replaced versions no reader can still see; Update() does this as it goes.
+    void Reclaim()
+    {
+        std::lock_guard lock(m_writer);
+        ReclaimLocked();
+    }
+    // Replaced versions not yet freed.
+    std::size_t PendingReclaim() const
+    {
+        std::lock_guard lock(m_writer);
+        return m_retired.size();
+    }
+
+private:
+    struct Retired
+    {
+        std::uint64_t                   epoch;
+        std::unique_ptr<const FileItem> version;
+    };
+
+    void ReclaimLocked()
+    {
+        const std::uint64_t oldest = m_domain.OldestPinned();
+        std::erase_if(m_retired, [oldest](const Retired& retired) { return retired.epoch < oldest; });
+    }
+
+    EpochDomain&                    m_domain;
+    std::atomic<const FileItem*>    m_current;
+    mutable std::mutex              m_writer;
+    std::vector<Retired>            m_retired;
+};
@@ -0,0 +1,1277 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <stack>
+#include <vector>
+#include <span>
+#include "Hash64.h"
+#include "NamePool.h"
+#include "TreeMetrics.h"
+
+// Build with -DFILEEXAMPLE_COMPACT_NODES=1 (cmake -DFILEEXAMPLE_COMPACT_NODES=ON) for the
+// compact node layout, which makes a FileItem 32 bytes instead of 80: every name is a NamePool
+// id, and a container keeps its allocator in its child block (see NamedFileItem and
+// ContainerFileItem for what each costs).
+#ifndef FILEEXAMPLE_COMPACT_NODES
+#define FILEEXAMPLE_COMPACT_NODES 0
+#endif
+inline constexpr bool kCompactNodes = FILEEXAMPLE_COMPACT_NODES;
+
+using FileItemVariant = std::variant<class Drive, class File, class Directory>;
+using Path = std::vector<int>;
+struct NonExist : std::runtime_error {NonExist():std::runtime_error("Does not exist"){}};
+struct CannotRename : std::runtime_error {CannotRename():std::runtime_error("Cannot rename"){}};
+struct CannotMove : std::runtime_error {CannotMove():std::runtime_error("Cannot move"){}};
+// Result of the non-throwing operations; each failure matches the exception of the same name.
+enum class TreeStatus { Ok, NonExist, CannotRename, CannotMove };
+
+class FileItem;
+
+template<class T>
+concept FileItemAlternative = std::is_same_v<std::remove_cvref_t<T>, Drive>
+                           || std::is_same_v<std::remove_cvref_t<T>, Directory>
+                           || std::is_same_v<std::remove_cvref_t<T>, File>;
+template<class T>
+concept FileItemNode = FileItemAlternative<T> || std::is_same_v<std::remove_cvref_t<T>, FileItem>;
+
+// Process-wide change counters. StructureGeneration is bumped by every operation that can
+// move or destroy nodes that are already in a tree (assigning over a node or a container's
+// children), and by every copy that starts sharing a container's children, since a pointer
+// into them is no longer safe to write through; NameGeneration by every rename. Caches of
+// pointers into a tree, or of names, compare them to decide whether they may still be valid.
+template<class Tag>
+class Generation
+{
+    static inline std::atomic<std::uint64_t> s_generation{0};
+public:
+    static std::uint64_t Current() { return s_generation.load(std::memory_order_acquire); }
+    static void Bump() { s_generation.fetch_add(1, std::memory_order_acq_rel); }
+};
+using StructureGeneration = Generation<struct StructureTag>;
+using NameGeneration = Generation<struct NameTag>;
+
+#if FILEEXAMPLE_COMPACT_NODES
+// In the compact layout the name is only its NamePool id, whatever the constructor: 4 bytes,
+// and copies never allocate. The pool never frees, so every name a node has ever had stays
+// in it, and every construction and rename takes the pool's lock.
+class NamedFileItem
+{
+    static constexpr NamePool::Id kUnnamed = ~NamePool::Id{0};
+
+    NamePool::Id        m_interned{kUnnamed};
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    NamedFileItem() = default;
+    NamedFileItem(std::string_view name, const allocator_type& = {}):m_interned(NamePool::Global().Intern(name)) {}
+    NamedFileItem(Interned name, const allocator_type& = {}):m_interned(NamePool::Global().Intern(name.name)) {}
+    NamedFileItem(const NamedFileItem&) = default;
+    NamedFileItem(NamedFileItem&&) = default;
+    NamedFileItem(const NamedFileItem& other, const allocator_type&):m_interned(other.m_interned) {}
+    NamedFileItem(NamedFileItem&& other, const allocator_type&):m_interned(other.m_interned) {}
+    NamedFileItem& operator=(const NamedFileItem&) = default;
+    NamedFileItem& operator=(NamedFileItem&&) = default;
+
+    std::string_view GetName() const
+    {
+        return m_interned == kUnnamed ? std::string_view{} : NamePool::Global().View(m_interned);
+    }
+    void SetName(std::string_view n)
+    {
+        m_interned = NamePool::Global().Intern(n);
+        NameGeneration::Bump();
+    }
+    bool IsInterned() const { return true; }
+    void Intern() {}
+    void ReleaseName() { m_interned = kUnnamed; }
+};
+#else
+class NamedFileItem
+{
+    static constexpr NamePool::Id kNotInterned = ~NamePool::Id{0};
+
+    std::pmr::string    m_name;
+    NamePool::Id        m_interned{kNotInterned};
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    NamedFileItem() = default;
+    NamedFileItem(std::string_view name, const allocator_type& alloc = {}):m_name(name, alloc) { CountAllocation(); }
+    NamedFileItem(Interned name, const allocator_type& alloc = {}):m_name(alloc), m_interned(NamePool::Global().Intern(name.name)) {}
+    NamedFileItem(const NamedFileItem& other):m_name(other.m_name), m_interned(other.m_interned) { CountAllocation(); }
+    NamedFileItem(NamedFileItem&&) = default;
+    NamedFileItem(const NamedFileItem& other, const allocator_type& alloc):m_name(other.m_name, alloc), m_interned(other.m_interned) { CountAllocation(); }
+    NamedFileItem(NamedFileItem&& other, const allocator_type& alloc):m_name(std::move(other.m_name), alloc), m_interned(other.m_interned) {}
+    NamedFileItem& operator=(const NamedFileItem&) = default;
+    NamedFileItem& operator=(NamedFileItem&&) = default;
+
+    std::string_view GetName() const
+    {
+        return IsInterned() ? NamePool::Global().View(m_interned) : std::string_view{m_name};
+    }
+    void SetName(std::string_view n)
+    {
+        if (IsInterned())
+            m_interned = NamePool::Global().Intern(n);
+        else
+        {
+            [[maybe_unused]] const std::size_t capacity = m_name.capacity();
+            m_name = n;
+            if (m_name.capacity() != capacity)
+                CountAllocation();
+        }
+        NameGeneration::Bump();
+    }
+    bool IsInterned() const { return m_interned != kNotInterned; }
+    // Moves the name into the pool and releases the owned string.
+    void Intern()
+    {
+        if (IsInterned())
+            return;
+        m_interned = NamePool::Global().Intern(m_name);
+        m_name.clear();
+        m_name.shrink_to_fit();
+    }
+    // Drops the name and its storage, for containers that keep their children's names
+    // themselves (see SortedDirectory.h).
+    void ReleaseName()
+    {
+        m_name.clear();
+        m_name.shrink_to_fit();
+        m_interned = kNotInterned;
+    }
+private:
+    // Names longer than the inline buffer are allocated.
+    void CountAllocation() const
+    {
+        FILEEXAMPLE_METRIC(BytesAllocated, m_name.capacity() > std::pmr::string().capacity() ? m_name.capacity() + 1 : 0);
+    }
+};
+#endif
+
+// Summary of the subtree below a container, cached with its children (see
+// ContainerFileItem::Aggregates).
+struct TreeAggregates
+{
+    std::uint64_t   descendants{0};
+    std::uint64_t   files{0};
+    // sum of the files' sizes
+    std::uint64_t   bytes{0};
+    // edges on the longest path down from the container
+    std::uint32_t   depth{0};
+};
+
+// Children live in a std::pmr::vector, and FileItem is allocator-aware, so a tree constructed
+// with an allocator (see TreeArena) keeps every vector and name it owns in that allocator.
+//
+// The vector is held in a reference-counted block that copies of the container share, so
+// copying a tree (taking a snapshot) is O(1). Any non-const access to the children first
+// gives this container its own block, copying the child nodes (but not their subtrees); a
+// mutation through FileItem::operator[](Path) therefore copies only the spine from the root
+// to the node it reaches. References obtained before a copy was taken still point into the
+// shared block, so re-resolve them after snapshotting.
+//
+// In the compact layout the container is only the pointer to the block, and the allocator
+// is the block's. A container in any resource but the default one therefore always has a
+// block, even while it is empty.
+class ContainerFileItem
+{
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+private:
+    // Name hash -> child index for large containers. Built on the first Find(), extended by
+    // appends and dropped by every other non-const access to the children, so it serves only
+    // its own block and changes elsewhere never cost it a rebuild; never copied with the
+    // block. Keyed by hash rather than by the names themselves, and every hit is checked
+    // against the child, so a rename the index missed can make it miss a child but never read
+    // a freed name. It lives in the block's allocator, like everything else the tree owns (see
+    // TreeArena::Discard).
+    struct NameIndex
+    {
+        std::pmr::unordered_multimap<std::uint64_t, int>    positions;
+    };
+    struct NameIndexDeleter
+    {
+        void operator()(NameIndex* index) const
+        {
+            allocator_type alloc = index->positions.get_allocator();
+            alloc.delete_object(index);
+        }
+    };
+    static constexpr std::uint64_t kUncomputedDigest = 0;
+    struct ChildBlock
+    {
+        ChildBlock(const allocator_type& alloc) : items(alloc) { CountAllocation(false); }
+        ChildBlock(std::pmr::vector<FileItem>&& contents) : items(std::move(contents)) { CountAllocation(false); }
+        ChildBlock(const std::pmr::vector<FileItem>& contents, const allocator_type& alloc) : items(contents, alloc) { CountAllocation(true); }
+        ChildBlock(std::pmr::vector<FileItem>&& contents, const allocator_type& alloc)
+            : items(std::move(contents), alloc) { CountAllocation(contents.get_allocator() != alloc); }
+        ~ChildBlock();
+        // the block itself, and its vector if it was copied rather than adopted
+        void CountAllocation([[maybe_unused]] bool copied) const
+        {
+            FILEEXAMPLE_METRIC(BytesAllocated, sizeof(ChildBlock) + (copied ? ItemBytes(items.capacity()) : 0));
+        }
+        std::pmr::vector<FileItem>          items;
+        mutable std::unique_ptr<NameIndex, NameIndexDeleter> name_index;
+        mutable TreeAggregates              aggregates;
+        mutable bool                        aggregates_valid{false};
+        // kUncomputedDigest until Digest() runs; atomic, so concurrent readers may fill it
+        mutable std::atomic<std::uint64_t>  digest{kUncomputedDigest};
+    };
+    // Counts the recursive tree operations below in progress on this thread. Recursion is
+    // cheaper than an explicit stack but bounded by the thread's stack, so past kMaxNesting
+    // levels they switch to one.
+    class Nesting
+    {
+        static constexpr int kMaxNesting = 256;
+        static inline thread_local int t_depth = 0;
+    public:
+        Nesting() { ++t_depth; }
+        ~Nesting() { --t_depth; }
+        Nesting(const Nesting&) = delete;
+        Nesting& operator=(const Nesting&) = delete;
+        bool TooDeep() const { return t_depth > kMaxNesting; }
+    };
+    // Calls fill(block) on every block under and including root for which stale(block) holds,
+    // each after those of its children, with an explicit stack.
+    template<class Stale, class Fill>
+    static void FillBottomUp(const ChildBlock& root, Stale&& stale, Fill&& fill);
+    template<class... Args>
+    static std::shared_ptr<ChildBlock> MakeChildren(const allocator_type& alloc, Args&&... args)
+    {
+        return std::allocate_shared<ChildBlock>(std::pmr::polymorphic_allocator<ChildBlock>(alloc), std::forward<Args>(args)...);
+    }
+    // The block of an empty container in alloc: none, unless the layout needs it to keep alloc.
+    static std::shared_ptr<ChildBlock> EmptyChildren([[maybe_unused]] const allocator_type& alloc)
+    {
+        if constexpr (kCompactNodes)
+            if (alloc != allocator_type{})
+                return MakeChildren(alloc, alloc);
+        return nullptr;
+    }
+    // A copy of other's children in alloc: shared when the allocators match, deep otherwise.
+    static std::shared_ptr<ChildBlock> ShareOrCopy(const ContainerFileItem& other, const allocator_type& alloc)
+    {
+        if (!other.m_children)
+            return EmptyChildren(alloc);
+        if (other.GetAllocator() == alloc)
+        {
+            StructureGeneration::Bump();
+            return other.m_children;
+        }
+        return MakeChildren(alloc, other.m_children->items, alloc);
+    }
+    // As ShareOrCopy, but may steal other's block, or its nodes if nobody else shares them.
+    static std::shared_ptr<ChildBlock> ShareOrMove(ContainerFileItem&& other, const allocator_type& alloc)
+    {
+        if (!other.m_children)
+            return EmptyChildren(alloc);
+        if (other.GetAllocator() == alloc)
+            return std::move(other.m_children);
+        if (other.m_children.use_count() > 1)
+            return ShareOrCopy(other, alloc);
+        return MakeChildren(alloc, std::move(other.m_children->items), alloc);
+    }
+    static std::size_t ItemBytes(std::size_t count);
+    // Counts the reallocation of items, if any, between construction and destruction.
+    class GrowthCounter
+    {
+#if FILEEXAMPLE_METRICS
+        const std::pmr::vector<FileItem>&   m_items;
+        std::size_t                         m_capacity;
+    public:
+        explicit GrowthCounter(const std::pmr::vector<FileItem>& items) : m_items(items), m_capacity(items.capacity()) {}
+        ~GrowthCounter()
+        {
+            if (m_items.capacity() != m_capacity)
+                FILEEXAMPLE_METRIC(BytesAllocated, ItemBytes(m_items.capacity()));
+        }
+#else
+    public:
+        explicit GrowthCounter(const std::pmr::vector<FileItem>&) {}
+#endif
+    };
+    // The children for reading (empty when there is no block yet) and for writing (this
+    // container's own block, copied first if it is shared).
+    const std::pmr::vector<FileItem>& Items() const;
+    std::pmr::vector<FileItem>& Items();
+    // Items() for appending at the end: the name index is kept, and IndexAppended() adds the
+    // new last child to it.
+    std::pmr::vector<FileItem>& ItemsForAppend();
+    void IndexAppended();
+    static std::uint64_t NameKey(std::string_view name) { return Hash64::Bytes(name.data(), name.size()); }
+
+    ContainerFileItem(const allocator_type& alloc, std::shared_ptr<ChildBlock> children)
+#if FILEEXAMPLE_COMPACT_NODES
+        : m_children(children ? std::move(children) : EmptyChildren(alloc))
+#else
+        : m_alloc(alloc), m_children(std::move(children))
+#endif
+        {}
+
+#if !FILEEXAMPLE_COMPACT_NODES
+    allocator_type              m_alloc;
+#endif
+    std::shared_ptr<ChildBlock>   m_children;
+public:
+    // Containers with fewer children are searched linearly.
+    static constexpr int kNameIndexThreshold = 32;
+    // The digest of a container without children.
+    static constexpr std::uint64_t kEmptyDigest = 0x9e3779b97f4a7c15ull;
+
+    ContainerFileItem() = default;
+    ContainerFileItem(const allocator_type& alloc): ContainerFileItem(alloc, nullptr) {}
+    ContainerFileItem(std::initializer_list<FileItem> list, const allocator_type& alloc = {})
+        : ContainerFileItem(alloc, list.size() ? MakeChildren(alloc, std::pmr::vector<FileItem>(list, alloc)) : nullptr)
+        {}
+    ContainerFileItem(std::pmr::vector<FileItem>&& contents)
+        : ContainerFileItem(contents.get_allocator(), MakeChildren(contents.get_allocator(), std::move(contents)))
+        {}
+    // Moves (or copies, for lvalues) each child straight into place; unlike the
+    // initializer_list constructor, rvalue subtrees are never copied.
+    template<FileItemNode... Children>
+    explicit ContainerFileItem(std::in_place_t, Children&&... children)
+    {
+        if constexpr (sizeof...(children) > 0)
+        {
+            auto& items = Items();
+            const GrowthCounter counter(items);
+            items.reserve(sizeof...(children));
+            (items.emplace_back(std::forward<Children>(children)), ...);
+        }
+    }
+    // Like a pmr container, a plain copy uses the default resource, so only trees in that
+    // resource are shared; a copy of an arena tree is deep.
+    ContainerFileItem(const ContainerFileItem& other): m_children(ShareOrCopy(other, allocator_type{})) {}
+    ContainerFileItem(ContainerFileItem&&) = default;
+    ContainerFileItem(const ContainerFileItem& other, const allocator_type& alloc): ContainerFileItem(alloc, ShareOrCopy(other, alloc)) {}
+    ContainerFileItem(ContainerFileItem&& other, const allocator_type& alloc): ContainerFileItem(alloc, ShareOrMove(std::move(other), alloc)) {}
+    ContainerFileItem& operator=(const ContainerFileItem& other)
+    {
+        m_children = ShareOrCopy(other, GetAllocator());
+        StructureGeneration::Bump();
+        return *this;
+    }
+    ContainerFileItem& operator=(ContainerFileItem&& other)
+    {
+        m_children = ShareOrMove(std::move(other), GetAllocator());
+        StructureGeneration::Bump();
+        return *this;
+    }
+
+    template<class Fn>
+    void Visit(Fn&& fn)
+    {
+        if (!m_children)
+            return;
+        for (auto& c:Items()) fn(c);
+    }
+    template<class Fn>
+    void Visit(Fn&& fn) const
+    {
+        for (const auto& c:Items()) fn(c);
+    }
+    FileItem* TryGet(int idx) { return idx<0 || idx>=Size() ? nullptr : &Items()[idx]; }
+    const FileItem* TryGet(int idx) const { return idx<0 || idx>=Size() ? nullptr : &Items()[idx]; }
+    FileItem& Get(int idx) { if (FileItem* fi = TryGet(idx)) return *fi; FILEEXAMPLE_METRIC(NonExistMisses, 1); throw NonExist{}; }
+    const FileItem& Get(int idx) const { if (const FileItem* fi = TryGet(idx)) return *fi; FILEEXAMPLE_METRIC(NonExistMisses, 1); throw NonExist{}; }
+    int Size() const { return m_children ? (int)m_children->items.size() : 0; }
+    void Reserve(int size)
+    {
+        auto& items = Items();
+        const GrowthCounter counter(items);
+        items.reserve(size);
+    }
+    // True when another copy of this container still shares its children.
+    bool IsShared() const { return m_children && m_children.use_count() > 1; }
+    // True when the two containers hold the very same children: one is a copy of the other
+    // and neither has had non-const access to them since. Both empty also counts.
+    bool SharesChildrenWith(const ContainerFileItem& other) const { return m_children == other.m_children; }
+    // Appends a child, moving it (and its subtree) into this container's allocator.
+    // Existing children may move in memory.
+    FileItem& AddChild(FileItem&& child);
+    FileItem& AddChild(const FileItem& child);
+    // Inserts child before position idx (Size() appends) and removes the child at idx; both
+    // throw NonExist for a position out of range. Later children shift by one.
+    FileItem& InsertChild(int idx, FileItem&& child);
+    void RemoveChild(int idx);
+    // Removes the child at idx and returns it. Its subtree moves with it, so taking a child
+    // from one container and inserting it into another is O(1) in the size of the subtree
+    // when both use the same allocator; in different allocators InsertChild copies it.
+    FileItem TakeChild(int idx);
+    // Removes every child and returns them, in O(1) unless the children are shared, in which
+    // case this container gets its own copy of them first, like any other write.
+    std::pmr::vector<FileItem> TakeChildren();
+    // Sorts the children by name, in byte order, keeping children of equal names in order.
+    // The sort runs over (name, position) pairs and then moves each child once into place,
+    // rather than swapping whole nodes O(n log n) times. A container already in order is
+    // not written, so if it is shared it stays shared.
+    void SortByName();
+    bool IsSortedByName() const;
+    // Constructs a child of type FileItemType in place from args and returns it.
+    template<FileItemAlternative FileItemType, class... Args>
+    FileItemType& Emplace(Args&&... args)
+    {
+        auto& items = ItemsForAppend();
+        const GrowthCounter counter(items);
+        // the vector passes its allocator last; alternatives that cannot take it there (a
+        // Directory built from children) are built first and moved in
+        if constexpr (std::is_constructible_v<FileItemType, Args..., const allocator_type&>)
+            items.emplace_back(std::in_place_type<FileItemType>, std::forward<Args>(args)...);
+        else
+            items.emplace_back(FileItemType(std::forward<Args>(args)...));
+        IndexAppended();
+        StructureGeneration::Bump();
+        return std::get<FileItemType>(items.back());
+    }
+    // Index of the first child called name, or -1. Not safe to call concurrently on the same
+    // container: the index is built lazily. Like Aggregates(), it follows renames made through
+    // non-const access to this container; a child renamed through a reference kept from before
+    // may not be found under its new name until the next such access.
+    int Find(std::string_view name) const;
+    // Counts over the whole subtree, cached and recomputed on the next call after a change. Every
+    // non-const access to the children marks the cache dirty, and reaching a node to change it
+    // through FileItem::operator[] or FileItem::Find (by Path or by name) or through Visit makes
+    // that access on each container on the way, so
+    // a mutation dirties only its spine and the next call recomputes only that. A reference kept
+    // across a call and used to change the subtree later leaves the ancestors' counts stale.
+    // Not safe to call concurrently on the same container.
+    const TreeAggregates& Aggregates() const;
+    // Merkle digest of the subtree: a hash over each child's kind and name and, for container
+    // children, their own digests, in child order. The container's own name is not included;
+    // its parent's digest covers it. Cached and dirtied along the spine like Aggregates(), so
+    // after a rename or insert only the spine is rehashed. Equal trees have equal digests
+    // however they were built. Safe to call concurrently.
+    std::uint64_t Digest() const;
+    // True when Digest() would return without hashing.
+    bool IsDigestCached() const
+    {
+        return !m_children || m_children->digest.load(std::memory_order_acquire) != kUncomputedDigest;
+    }
+#if FILEEXAMPLE_COMPACT_NODES
+    allocator_type GetAllocator() const { return m_children ? allocator_type(m_children->items.get_allocator()) : allocator_type{}; }
+#else
+    allocator_type GetAllocator() const { return m_alloc; }
+#endif
+};
+
+class Drive : public ContainerFileItem
+{
+    char                    m_drive_letter{'a'};
+public:
+    Drive(char id) : m_drive_letter(id) {}
+    Drive(char id, const allocator_type& alloc) : ContainerFileItem(alloc), m_drive_letter(id) {}
+    Drive(char id, std::initializer_list<FileItem> contents, const allocator_type& alloc = {})
+        : ContainerFileItem(contents, alloc)
+        , m_drive_letter(id)
+        {}
+    template<FileItemNode... Children>
+    Drive(char id, Children&&... children)
+        : ContainerFileItem(std::in_place, std::forward<Children>(children)...)
+        , m_drive_letter(id)
+        {}
+    Drive(char id, std::pmr::vector<FileItem>&& contents)
+        : ContainerFileItem(std::move(contents))
+        , m_drive_letter(id)
+        {}
+    Drive(const Drive&) = default;
+    Drive(Drive&&) = default;
+    Drive(const Drive& other, const allocator_type& alloc) : ContainerFileItem(other, alloc), m_drive_letter(other.m_drive_letter) {}
+    Drive(Drive&& other, const allocator_type& alloc) : ContainerFileItem(std::move(other), alloc), m_drive_letter(other.m_drive_letter) {}
+    Drive& operator=(const Drive&) = default;
+    Drive& operator=(Drive&&) = default;
+
+    std::string_view GetName() const { return std::string_view{&m_drive_letter, 1}; }
+};
+
+
+
+class Directory : public ContainerFileItem, public NamedFileItem
+{
+public:
+    using allocator_type = ContainerFileItem::allocator_type;
+
+    Directory() = default;
+    Directory(std::string_view name, const allocator_type& alloc = {}) : ContainerFileItem(alloc), NamedFileItem(name, alloc) {}
+    Directory(std::string_view name, std::initializer_list<FileItem> list, const allocator_type& alloc = {}) : ContainerFileItem(list, alloc), NamedFileItem(name, alloc) {}
+    Directory(Interned name, std::initializer_list<FileItem> list = {}, const allocator_type& alloc = {}) : ContainerFileItem(list, alloc), NamedFileItem(name, alloc) {}
+    template<FileItemNode... Children>
+    Directory(std::string_view name, Children&&... children)
+        : ContainerFileItem(std::in_place, std::forward<Children>(children)...)
+        , NamedFileItem(name)
+        {}
+    Directory(std::string_view name, std::pmr::vector<FileItem>&& contents)
+        : ContainerFileItem(std::move(contents))
+        , NamedFileItem(name, GetAllocator())
+        {}
+    Directory(const Directory&) = default;
+    Directory(Directory&&) = default;
+    Directory(const Directory& other, const allocator_type& alloc) : ContainerFileItem(other, alloc), NamedFileItem(other, alloc) {}
+    Directory(Directory&& other, const allocator_type& alloc) : ContainerFileItem(std::move(other), alloc), NamedFileItem(std::move(other), alloc) {}
+    Directory& operator=(const Directory&) = default;
+    Directory& operator=(Directory&&) = default;
+};
+
+// What stat() reports for a file, in the units it reports them.
+struct FileAttributes
+{
+    std::uint64_t   size{0};
+    // nanoseconds since the Unix epoch
+    std::int64_t    mtime{0};
+    std::uint32_t   mode{0};
+
+    bool operator==(const FileAttributes&) const = default;
+};
+
+// The attributes are kept with the node so that an editable tree can carry them; bulk scans
+// over them should use the columns of a FlatTree (see FlatTree.h) instead.
+// In the compact layout the fields are laid out mode first, so they pack behind the 4-byte name
+// id instead of padding out to a second 8-byte boundary as a FileAttributes member would.
+class File : public NamedFileItem
+{
+#if FILEEXAMPLE_COMPACT_NODES
+    std::uint32_t   m_mode{0};
+    std::uint64_t   m_size{0};
+    std::int64_t    m_mtime{0};
+#else
+    FileAttributes  m_attributes;
+#endif
+public:
+    using NamedFileItem::NamedFileItem;
+    File(std::string_view name, const FileAttributes& attributes, const allocator_type& alloc = {})
+        : NamedFileItem(name, alloc) { SetAttributes(attributes); }
+    File(const File&) = default;
+    File(File&&) = default;
+    File(const File& other, const allocator_type& alloc) : NamedFileItem(other, alloc) { SetAttributes(other.GetAttributes()); }
+    File(File&& other, const allocator_type& alloc) : NamedFileItem(std::move(other), alloc) { SetAttributes(other.GetAttributes()); }
+    File& operator=(const File&) = default;
+    File& operator=(File&&) = default;
+
+#if FILEEXAMPLE_COMPACT_NODES
+    FileAttributes GetAttributes() const { return FileAttributes{m_size, m_mtime, m_mode}; }
+    void SetAttributes(const FileAttributes& attributes)
+    {
+        m_mode = attributes.mode;
+        m_size = attributes.size;
+        m_mtime = attributes.mtime;
+    }
+#else
+    const FileAttributes& GetAttributes() const { return m_attributes; }
+    void SetAttributes(const FileAttributes& attributes) { m_attributes = attributes; }
+#endif
+};
+
+// What each alternative supports, indexed by FileItemVariant::index(), so that hot paths can
+// test one flag instead of dispatching through std::visit.
+struct FileItemCapabilities
+{
+    bool is_container;
+    bool is_named;
+};
+template<std::size_t... I>
+constexpr auto MakeCapabilityTable(std::index_sequence<I...>)
+{
+    return std::array<FileItemCapabilities, sizeof...(I)>{FileItemCapabilities{
+        std::is_base_of_v<ContainerFileItem, std::variant_alternative_t<I, FileItemVariant>>,
+        std::is_base_of_v<NamedFileItem, std::variant_alternative_t<I, FileItemVariant>>}...};
+}
+inline constexpr auto kFileItemCapabilities = MakeCapabilityTable(std::make_index_sequence<std::variant_size_v<FileItemVariant>>{});
+
+class FileItem : public FileItemVariant
+{
+    // dispatch
+    template<class Fn>
+    void Recurse(Fn& fn, Path& path) const
+    {
+        const auto& as_variant = static_cast<const FileItemVariant&>(*this);
+        std::visit(
+            [&fn, &path](const auto& item) {
+                fn(item, std::as_const(path));
+                Recurse(fn, item, path);
+            }, as_variant);
+    }
+    // process
+    template<class Fn, class FileItemType>
+    static void Recurse(Fn& fn, const FileItemType& item, Path& path)
+    {
+        if constexpr (std::is_base_of_v<ContainerFileItem, FileItemType>)
+        {
+            item.Visit([&fn, &path, i=0] (const FileItem& fi) mutable
+            {
+                path.push_back(i++);
+                fi.Recurse(fn, path);
+                path.pop_back();
+            });
+        }
+    }
+    // allocation
+    template<class V>
+    static FileItemVariant Rebind(V&& variant, const std::pmr::polymorphic_allocator<>& alloc)
+    {
+        return std::visit(
+            [&alloc](auto&& item)->FileItemVariant {
+                using FileItemType = std::remove_cvref_t<decltype(item)>;
+                return FileItemVariant(std::in_place_type<FileItemType>, std::forward<decltype(item)>(item), alloc);
+            }, std::forward<V>(variant));
+    }
+    // access: the alternative as Base, found by comparing index() against the alternatives
+    // deriving from Base only
+    template<class Base, std::size_t I, class Variant>
+    static Base* BaseAt(Variant& variant)
+    {
+        if constexpr (std::is_base_of_v<std::remove_const_t<Base>, std::variant_alternative_t<I, FileItemVariant>>)
+            return variant.index() == I ? std::get_if<I>(&variant) : nullptr;
+        else
+            return nullptr;
+    }
+    template<class Base, class Variant, std::size_t... I>
+    static Base* AsBase(Variant& variant, std::index_sequence<I...>)
+    {
+        Base* base = nullptr;
+        ((base = base ? base : BaseAt<Base, I>(variant)), ...);
+        return base;
+    }
+    template<class Base, class Variant>
+    static Base* AsBase(Variant& variant)
+    {
+        return AsBase<Base>(variant, std::make_index_sequence<std::variant_size_v<FileItemVariant>>{});
+    }
+    // lookup by name, for both constnesses
+    template<class Self>
+    static Self* FindIn(Self& self, std::string_view path);
+    // lookup by Path, for both constnesses
+    template<class Self>
+    static Self* TryGet(Self& self, const Path& path)
+    {
+        Self* current = &self;
+        [[maybe_unused]] std::size_t depth = 0;
+        for (int idx : path)
+        {
+            if (!(current = current->TryGet(idx)))
+                break;
+            ++depth;
+        }
+        FILEEXAMPLE_METRIC(PathLookups, 1);
+        FILEEXAMPLE_METRIC(PathDepth, depth);
+        if (!current)
+            FILEEXAMPLE_METRIC(NonExistMisses, 1);
+        return current;
+    }
+public:
+    using FileItemVariant::FileItemVariant;
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    FileItem(const FileItem&) = default;
+    FileItem(FileItem&&) = default;
+    FileItem& operator=(const FileItem& other)
+    {
+        FileItemVariant::operator=(static_cast<const FileItemVariant&>(other));
+        StructureGeneration::Bump();
+        return *this;
+    }
+    FileItem& operator=(FileItem&& other)
+    {
+        FileItemVariant::operator=(static_cast<FileItemVariant&&>(other));
+        StructureGeneration::Bump();
+        return *this;
+    }
+    // allocator-extended construction, used by std::pmr::vector<FileItem> and TreeArena
+    FileItem(std::allocator_arg_t, const allocator_type& alloc, const FileItem& other)
+        : FileItemVariant(Rebind(static_cast<const FileItemVariant&>(other), alloc)) {}
+    FileItem(std::allocator_arg_t, const allocator_type& alloc, FileItem&& other)
+        : FileItemVariant(Rebind(static_cast<FileItemVariant&&>(other), alloc)) {}
+    template<FileItemAlternative FileItemType>
+    FileItem(std::allocator_arg_t, const allocator_type& alloc, FileItemType&& item)
+        : FileItemVariant(std::in_place_type<std::remove_cvref_t<FileItemType>>, std::forward<FileItemType>(item), alloc) {}
+ 
+    // Visits every node by reference; one path buffer is shared by the whole walk,
+    // so a visitor that keeps the path must copy it.
+    template<class Fn>
+    void Recurse(Fn&& fn) const
+    {
+        Path path;
+#if FILEEXAMPLE_METRICS
+        const TreeMetrics::Timer timer(TreeMetrics::RecurseNanoseconds);
+        std::uint64_t nodes = 0;
+        auto counted = [&fn, &nodes](const auto& item, const Path& at) {
+            ++nodes;
+            fn(item, at);
+        };
+        Recurse(counted, path);
+        FILEEXAMPLE_METRIC(RecurseCalls, 1);
+        FILEEXAMPLE_METRIC(RecurseNodes, nodes);
+#else
+        Recurse(fn, path);
+#endif
+    }
+    // As Recurse, but the visitor receives the path as a std::span<const int>.
+    template<class Fn>
+    void Traverse(Fn&& fn) const
+    {
+        auto as_span = [&fn](const auto& item, const Path& path) {
+            fn(item, std::span<const int>(path.data(), path.size()));
+        };
+        Recurse(as_span);
+    }
+    // The Try* operations report failure through their result instead of throwing; the
+    // throwing operations are wrappers over them.
+    TreeStatus TryRename(std::string_view new_name)
+    {
+        FILEEXAMPLE_METRIC(RenameCalls, 1);
+        NamedFileItem* named = AsNamed();
+        if (!named)
+            return TreeStatus::CannotRename;
+        named->SetName(new_name);
+        return TreeStatus::Ok;
+    }
+    TreeStatus TryRename(const Path& path, std::string_view new_name)
+    {
+        FileItem* target = TryGet(path);
+        return target ? target->TryRename(new_name) : TreeStatus::NonExist;
+    }
+    void Rename(std::string_view new_name)
+    {
+        if (TryRename(new_name) != TreeStatus::Ok)
+            throw CannotRename{};
+    }
+    // Moves the node at from, and its subtree, to position idx (-1 appends) of the container
+    // at to, without copying the subtree (see ContainerFileItem::TakeChild). to is a path in
+    // the tree as it is before the move, and idx a position among to's children once the node
+    // has left. Like a mutation through operator[](Path), this gives both spines their own
+    // children. CannotMove for the root, a destination in the node's own subtree or one that
+    // is not a container; NonExist for a path or position that does not exist.
+    TreeStatus TryMove(const Path& from, const Path& to, int idx = -1)
+    {
+        if (from.empty() || (to.size() >= from.size() && std::equal(from.begin(), from.end(), to.begin())))
+            return TreeStatus::CannotMove;
+        const Path from_parent(from.begin(), from.end() - 1);
+        const FileItem* target = std::as_const(*this).TryGet(to);
+        if (!std::as_const(*this).TryGet(from) || !target)
+            return TreeStatus::NonExist;
+        if (!target->IsContainer())
+            return TreeStatus::CannotMove;
+        const int room = target->AsContainer()->Size() - (to == from_parent ? 1 : 0);
+        if (idx < -1 || idx > room)
+            return TreeStatus::NonExist;
+        FileItem moved = TryGet(from_parent)->AsContainer()->TakeChild(from.back());
+        // taking the node out renumbers its later siblings, which the path to may run through
+        Path destination = to;
+        const std::size_t level = from_parent.size();
+        if (destination.size() > level && std::equal(from_parent.begin(), from_parent.end(), destination.begin())
+            && destination[level] > from.back())
+            --destination[level];
+        ContainerFileItem& container = *TryGet(destination)->AsContainer();
+        container.InsertChild(idx < 0 ? container.Size() : idx, std::move(moved));
+        return TreeStatus::Ok;
+    }
+    void Move(const Path& from, const Path& to, int idx = -1)
+    {
+        switch (TryMove(from, to, idx))
+        {
+        case TreeStatus::NonExist:      throw NonExist{};
+        case TreeStatus::CannotMove:    throw CannotMove{};
+        default:                        break;
+        }
+    }
+    // Sorts the children of every container in the subtree by name (see
+    // ContainerFileItem::SortByName). Only the containers out of order and their spines are
+    // written, so whatever a snapshot shares and is already sorted stays shared.
+    void SortByName()
+    {
+        std::vector<Path> unsorted;
+        Recurse([&unsorted](const auto& item, const Path& path) {
+            if constexpr (std::is_base_of_v<ContainerFileItem, std::remove_cvref_t<decltype(item)>>)
+                if (!item.IsSortedByName())
+                    unsorted.push_back(path);
+        });
+        // descendants first: sorting a container renumbers the paths below it
+        for (auto it = unsorted.rbegin(); it != unsorted.rend(); ++it)
+            TryGet(*it)->AsContainer()->SortByName();
+    }
+    std::string_view GetName() const
+    {
+        if (const NamedFileItem* named = AsNamed())
+            return named->GetName();
+        const auto& as_variant = static_cast<const FileItemVariant&>(*this);
+        return std::visit([](const auto& item) { return item.GetName(); }, as_variant);
+    }
+    // ContainerFileItem::Aggregates, or all zeros for a File.
+    const TreeAggregates& Aggregates() const
+    {
+        static const TreeAggregates s_leaf;
+        const ContainerFileItem* container = AsContainer();
+        return container ? container->Aggregates() : s_leaf;
+    }
+    // ContainerFileItem::Digest, or ContainerFileItem::kEmptyDigest for a File.
+    std::uint64_t Digest() const
+    {
+        const ContainerFileItem* container = AsContainer();
+        return container ? container->Digest() : ContainerFileItem::kEmptyDigest;
+    }
+    bool IsContainer() const { return kFileItemCapabilities[index()].is_container; }
+    bool IsNamed() const { return kFileItemCapabilities[index()].is_named; }
+    // This node as its container or named base, or nullptr if its alternative is neither.
+    ContainerFileItem* AsContainer()
+    {
+        return IsContainer() ? AsBase<ContainerFileItem>(static_cast<FileItemVariant&>(*this)) : nullptr;
+    }
+    const ContainerFileItem* AsContainer() const
+    {
+        return IsContainer() ? AsBase<const ContainerFileItem>(static_cast<const FileItemVariant&>(*this)) : nullptr;
+    }
+    NamedFileItem* AsNamed()
+    {
+        return IsNamed() ? AsBase<NamedFileItem>(static_cast<FileItemVariant&>(*this)) : nullptr;
+    }
+    const NamedFileItem* AsNamed() const
+    {
+        return IsNamed() ? AsBase<const NamedFileItem>(static_cast<const FileItemVariant&>(*this)) : nullptr;
+    }
+    // A copy that shares nothing with this tree; plain copies are O(1) snapshots.
+    FileItem Clone() const
+    {
+        FileItem copy = *this;
+        copy.Unshare();
+        return copy;
+    }
+    // Gives every container in the subtree its own children.
+    void Unshare()
+    {
+        auto& as_variant = static_cast<FileItemVariant&>(*this);
+        std::visit(
+            [](auto& item) {
+                if constexpr (std::is_base_of_v<ContainerFileItem, std::remove_cvref_t<decltype(item)>>)
+                    item.Visit([](FileItem& child) { child.Unshare(); });
+            }, as_variant);
+    }
+    // Switches every name in the subtree to interned storage.
+    void InternNames()
+    {
+        auto& as_variant = static_cast<FileItemVariant&>(*this);
+        std::visit(
+            [](auto& item) {
+                using FileItemType = std::remove_cvref_t<decltype(item)>;
+                if constexpr (std::is_base_of_v<NamedFileItem, FileItemType>)
+                    item.Intern();
+                if constexpr (std::is_base_of_v<ContainerFileItem, FileItemType>)
+                    item.Visit([](FileItem& child) { child.InternNames(); });
+            }, as_variant);
+    }
+    FileItem* TryGet(int idx)
+    {
+        ContainerFileItem* container = AsContainer();
+        return container ? container->TryGet(idx) : nullptr;
+    }
+    const FileItem* TryGet(int idx) const
+    {
+        const ContainerFileItem* container = AsContainer();
+        return container ? container->TryGet(idx) : nullptr;
+    }
+    // nullptr when any step of the path does not exist
+    const FileItem* TryGet(const Path& path) const
+    {
+        return TryGet(*this, path);
+    }
+    FileItem* TryGet(const Path& path)
+    {
+        return TryGet(*this, path);
+    }
+    FileItem& operator[](int idx)
+    {
+        if (FileItem* fi = TryGet(idx))
+            return *fi;
+        FILEEXAMPLE_METRIC(NonExistMisses, 1);
+        throw NonExist{};
+    }
+    const FileItem& operator[](int idx) const
+    {
+        if (const FileItem* fi = TryGet(idx))
+            return *fi;
+        FILEEXAMPLE_METRIC(NonExistMisses, 1);
+        throw NonExist{};
+    }
+    const FileItem& operator[](const Path& path) const
+    {
+        if (const FileItem* fi = TryGet(path))
+            return *fi;
+        throw NonExist{};
+    }
+    FileItem& operator[](const Path& path)
+    {
+        if (FileItem* fi = TryGet(path))
+            return *fi;
+        throw NonExist{};
+    }
+    // Name-based lookup: "a:/Animals/Aardvark" from a drive, or "Animals/Aardvark"
+    // relative to this node. Only a colon second in the path marks a drive letter; elsewhere
+    // it is part of a name, as in "logs/10:00.log". Returns nullptr when any component does not exist. The non-const
+    // lookup writes each container on the way like operator[](Path): it gets its own children
+    // and its cached aggregates and digest are dropped.
+    const FileItem* Find(std::string_view path) const { return FindIn(*this, path); }
+    FileItem* Find(std::string_view path) { return FindIn(*this, path); }
+    FileItem& operator[](std::string_view path)
+    {
+        if (FileItem* found = Find(path))
+            return *found;
+        throw NonExist{};
+    }
+};
+
+// The node sizes each layout is laid out for (LP64, libstdc++); a member that grows them
+// should be a deliberate choice. Every alternative of the compact layout fits in 24 bytes,
+// so a FileItem is those and the variant's index.
+#if FILEEXAMPLE_COMPACT_NODES
+static_assert(sizeof(NamedFileItem) <= 4);
+static_assert(sizeof(ContainerFileItem) <= 16);
+static_assert(sizeof(File) <= 24 && sizeof(Directory) <= 24 && sizeof(Drive) <= 24);
+static_assert(sizeof(FileItem) <= 32);
+#else
+static_assert(sizeof(ContainerFileItem) <= 24);
+static_assert(sizeof(FileItem) <= 80);
+#endif
+
+inline std::size_t ContainerFileItem::ItemBytes(std::size_t count)
+{
+    return count * sizeof(FileItem);
+}
+
+inline const std::pmr::vector<FileItem>& ContainerFileItem::Items() const
+{
+    static const std::pmr::vector<FileItem> s_empty;
+    return m_children ? m_children->items : s_empty;
+}
+
+inline std::pmr::vector<FileItem>& ContainerFileItem::Items()
+{
+    auto& items = ItemsForAppend();
+    m_children->name_index.reset();
+    return items;
+}
+
+inline std::pmr::vector<FileItem>& ContainerFileItem::ItemsForAppend()
+{
+    if (!m_children)
+        m_children = MakeChildren(GetAllocator(), GetAllocator());
+    else if (m_children.use_count() > 1)
+    {
+        // the copied nodes still share their own children with the snapshot
+        m_children = MakeChildren(GetAllocator(), m_children->items, GetAllocator());
+        StructureGeneration::Bump();
+    }
+    m_children->aggregates_valid = false;
+    m_children->digest.store(kUncomputedDigest, std::memory_order_relaxed);
+    return m_children->items;
+}
+
+inline void ContainerFileItem::IndexAppended()
+{
+    auto& index = m_children->name_index;
+    if (!index)
+        return;
+    const auto& items = m_children->items;
+    try
+    {
+        index->positions.emplace(NameKey(items.back().GetName()), static_cast<int>(items.size()) - 1);
+    }
+    catch (const std::bad_alloc&)
+    {
+        // the child is in; only the index is lost
+        index.reset();
+    }
+}
+
+// Children are freed by recursion down to kMaxNesting levels. The first block below that
+// takes the blocks of its children that nobody else shares and frees them one at a time, and
+// so does each of them, handing theirs to the same list; a deep chain then costs a loop rather
+// than one nested destructor per level. Should the list fail to grow, that child is destroyed
+// by recursion instead.
+inline ContainerFileItem::ChildBlock::~ChildBlock()
+{
+    thread_local std::vector<std::shared_ptr<ChildBlock>>* t_deferred = nullptr;
+    const Nesting nesting;
+    if (!nesting.TooDeep())
+    {
+        // here rather than after the body, so that the children count as nested
+        items.clear();
+        return;
+    }
+    std::vector<std::shared_ptr<ChildBlock>> deferred;
+    const bool first = t_deferred == nullptr;
+    if (first)
+        t_deferred = &deferred;
+    for (FileItem& child : items)
+    {
+        ContainerFileItem* container = child.AsContainer();
+        if (container && container->m_children.use_count() == 1)
+        {
+            try
+            {
+                t_deferred->push_back(std::move(container->m_children));
+            }
+            catch (const std::bad_alloc&)
+            {
+            }
+        }
+    }
+    items.clear();
+    if (!first)
+        return;
+    while (!deferred.empty())
+    {
+        const std::shared_ptr<ChildBlock> block = std::move(deferred.back());
+        deferred.pop_back();
+    }
+    t_deferred = nullptr;
+}
+
+template<class Stale, class Fill>
+void ContainerFileItem::FillBottomUp(const ChildBlock& root, Stale&& stale, Fill&& fill)
+{
+    std::vector<std::pair<const ChildBlock*, std::size_t>> stack{{&root, 0}};
+    while (!stack.empty())
+    {
+        auto& [block, next] = stack.back();
+        if (next == block->items.size())
+        {
+            fill(*block);
+            stack.pop_back();
+            continue;
+        }
+        const ContainerFileItem* container = block->items[next++].AsContainer();
+        if (container && container->m_children && stale(*container->m_children))
+            stack.emplace_back(container->m_children.get(), 0);
+    }
+}
+
+inline const TreeAggregates& ContainerFileItem::Aggregates() const
+{
+    static const TreeAggregates s_empty;
+    if (!m_children)
+        return s_empty;
+    if (!m_children->aggregates_valid)
+    {
+        const auto sum = [](const ChildBlock& block) {
+            TreeAggregates total;
+            for (const FileItem& child : block.items)
+            {
+                const TreeAggregates& below = child.Aggregates();
+                total.descendants += 1 + below.descendants;
+                total.files += below.files;
+                total.bytes += below.bytes;
+                if (const File* file = std::get_if<File>(&child))
+                {
+                    ++total.files;
+                    total.bytes += file->GetAttributes().size;
+                }
+                total.depth = std::max(total.depth, 1 + below.depth);
+            }
+            block.aggregates = total;
+            block.aggregates_valid = true;
+        };
+        if (const Nesting nesting; !nesting.TooDeep())
+            sum(*m_children);
+        else
+            FillBottomUp(*m_children, [](const ChildBlock& block) { return !block.aggregates_valid; }, sum);
+    }
+    return m_children->aggregates;
+}
+
+inline std::uint64_t ContainerFileItem::Digest() const
+{
+    if (!m_children)
+        return kEmptyDigest;
+    if (const std::uint64_t cached = m_children->digest.load(std::memory_order_acquire); cached != kUncomputedDigest)
+        return cached;
+    const auto hash = [](const ChildBlock& block) {
+        std::uint64_t digest = kEmptyDigest;
+        for (const FileItem& child : block.items)
+        {
+            const std::string_view name = child.GetName();
+            digest = Hash64::Bytes(name.data(), name.size(), digest + child.index());
+            if (const ContainerFileItem* container = child.AsContainer())
+                digest = Hash64::Combine(digest, container->Digest());
+        }
+        if (digest == kUncomputedDigest)
+            digest = kEmptyDigest;
+        block.digest.store(digest, std::memory_order_release);
+    };
+    if (const Nesting nesting; !nesting.TooDeep())
+        hash(*m_children);
+    else
+        FillBottomUp(*m_children, [](const ChildBlock& block) { return block.digest.load(std::memory_order_acquire) == kUncomputedDigest; }, hash);
+    return m_children->digest.load(std::memory_order_acquire);
+}
+
+inline FileItem& ContainerFileItem::AddChild(FileItem&& child)
+{
+    auto& items = ItemsForAppend();
+    const GrowthCounter counter(items);
+    auto& added = items.emplace_back(std::move(child));
+    IndexAppended();
+    StructureGeneration::Bump();
+    return added;
+}
+
+inline FileItem& ContainerFileItem::AddChild(const FileItem& child)
+{
+    auto& items = ItemsForAppend();
+    const GrowthCounter counter(items);
+    auto& added = items.emplace_back(child);
+    IndexAppended();
+    StructureGeneration::Bump();
+    return added;
+}
+
+inline FileItem& ContainerFileItem::InsertChild(int idx, FileItem&& child)
+{
+    if (idx < 0 || idx > Size())
+        throw NonExist{};
+    auto& items = Items();
+    const GrowthCounter counter(items);
+    auto& inserted = *items.emplace(items.begin() + idx, std::move(child));
+    StructureGeneration::Bump();
+    return inserted;
+}
+
+inline void ContainerFileItem::RemoveChild(int idx)
+{
+    if (idx < 0 || idx >= Size())
+        throw NonExist{};
+    auto& items = Items();
+    items.erase(items.begin() + idx);
+    StructureGeneration::Bump();
+}
+
+inline FileItem ContainerFileItem::TakeChild(int idx)
+{
+    if (idx < 0 || idx >= Size())
+        throw NonExist{};
+    auto& items = Items();
+    FileItem taken = std::move(items[idx]);
+    items.erase(items.begin() + idx);
+    StructureGeneration::Bump();
+    return taken;
+}
+
+inline std::pmr::vector<FileItem> ContainerFileItem::TakeChildren()
+{
+    if (!m_children)
+        return std::pmr::vector<FileItem>(GetAllocator());
+    auto& items = Items();
+    std::pmr::vector<FileItem> taken(std::move(items));
+    items.clear();
+    StructureGeneration::Bump();
+    return taken;
+}
+
+inline bool ContainerFileItem::IsSortedByName() const
+{
+    const auto& items = Items();
+    return std::is_sorted(items.begin(), items.end(), [](const FileItem& a, const FileItem& b) { return a.GetName() < b.GetName(); });
+}
+
+inline void ContainerFileItem::SortByName()
+{
+    if (IsSortedByName())
+        return;
+    auto& items = Items();
+    const int size = Size();
+    // pairs compare by position after name, which keeps equal names in order
+    std::vector<std::pair<std::string_view, int>> order;
+    order.reserve(items.size());
+    for (int i = 0; i < size; ++i)
+        order.emplace_back(items[i].GetName(), i);
+    std::sort(order.begin(), order.end());
+    // order[k].second is the child that belongs at k; follow each cycle of the permutation,
+    // holding its first child aside
+    std::vector<bool> placed(items.size(), false);
+    for (int start = 0; start < size; ++start)
+    {
+        if (placed[start] || order[start].second == start)
+            continue;
+        FileItem held = std::move(items[start]);
+        int k = start;
+        for (int from = order[k].second; from != start; k = from, from = order[k].second)
+        {
+            static_cast<FileItemVariant&>(items[k]) = std::move(static_cast<FileItemVariant&>(items[from]));
+            placed[k] = true;
+        }
+        static_cast<FileItemVariant&>(items[k]) = std::move(static_cast<FileItemVariant&>(held));
+        placed[k] = true;
+    }
+    StructureGeneration::Bump();
+}
+
+inline int ContainerFileItem::Find(std::string_view name) const
+{
+    const auto& items = Items();
+    if (Size() < kNameIndexThreshold)
+    {
+        for (int i = 0; i < Size(); ++i)
+            if (items[i].GetName() == name)
+                return i;
+        return -1;
+    }
+    auto& index = m_children->name_index;
+    if (!index)
+    {
+        allocator_type alloc = items.get_allocator();
+        index.reset(alloc.new_object<NameIndex>(NameIndex{std::pmr::unordered_multimap<std::uint64_t, int>(alloc)}));
+        index->positions.reserve(items.size());
+        for (int i = 0; i < Size(); ++i)
+            index->positions.emplace(NameKey(items[i].GetName()), i);
+    }
+    // the first child of that name, as the linear search finds
+    int found = -1;
+    const auto [first, last] = index->positions.equal_range(NameKey(name));
+    for (auto it = first; it != last; ++it)
+        if ((found < 0 || it->second < found) && it->second < Size() && items[it->second].GetName() == name)
+            found = it->second;
+    return found;
+}
+
+template<class Self>
+Self* FileItem::FindIn(Self& self, std::string_view path)
+{
+    Self* current = &self;
+    if (path.size() >= 2 && path[1] == ':')
+    {
+        const auto* drive = std::get_if<Drive>(&self);
+        if (!drive || drive->GetName() != path.substr(0, 1))
+            return nullptr;
+        path.remove_prefix(2);
+    }
+    while (!path.empty())
+    {
+        const auto slash = path.find('/');
+        const std::string_view component = path.substr(0, slash);
+        path.remove_prefix(slash == std::string_view::npos ? path.size() : slash + 1);
+        if (component.empty())
+            continue;
+        auto* container = current->AsContainer();
+        // the name is looked up without writing; only the child found is reached for writing
+        current = container ? container->TryGet(std::as_const(*container).Find(component)) : nullptr;
+        if (!current)
+        {
+            FILEEXAMPLE_METRIC(NonExistMisses, 1);
+            return nullptr;
+        }
+    }
+    return current;
+}
+
+// operator<<(std::ostream&, const FileItem&) is printed through TreePrinter. This comes last
+// so that either header may be included first.
+#include "TreePrinter.h"
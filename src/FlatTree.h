@@ -0,0 +1,202 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include "FileItem.h"
+
+// Matches the alternative order of FileItemVariant.
+enum class NodeKind : std::uint8_t { Drive, File, Directory };
+
+// Immutable struct-of-arrays snapshot of a FileItem tree. Nodes are numbered breadth-first
+// from the root (index 0), so the children of a node occupy a contiguous index range.
+// Names are packed into one blob; node i's name is [name_offset[i], name_offset[i+1]).
+// File attributes are three more columns with an entry for every node (zero for containers),
+// so scans over them are plain loops over contiguous arrays.
+// The columns are views onto storage shared by every copy of the tree: either vectors built
+// from a FileItem or a read-only file mapping (see TreeFile.h).
+class FlatTree
+{
+public:
+    using Index = std::uint32_t;
+    static constexpr Index kNone = ~Index{0};
+
+    struct Columns
+    {
+        std::span<const NodeKind>       kind;
+        std::span<const Index>          parent;
+        std::span<const Index>          first_child;
+        std::span<const Index>          child_count;
+        std::span<const std::uint32_t>  name_offset;    // Size() + 1 entries
+        std::string_view                names;
+        std::span<const std::uint64_t>  size;
+        std::span<const std::int64_t>   mtime;
+        std::span<const std::uint32_t>  mode;
+    };
+
+    class Node
+    {
+        const FlatTree* m_tree;
+        Index           m_index;
+    public:
+        Node(const FlatTree& tree, Index index) : m_tree(&tree), m_index(index) {}
+        Index GetIndex() const { return m_index; }
+        NodeKind GetKind() const { return m_tree->GetKind(m_index); }
+        std::string_view GetName() const { return m_tree->GetName(m_index); }
+        bool IsContainer() const { return GetKind() != NodeKind::File; }
+    };
+
+    explicit FlatTree(const FileItem& root)
+    {
+        auto owned = std::make_shared<OwnedColumns>();
+        std::deque<const FileItem*> pending{&root};
+        owned->parent.push_back(kNone);
+        while (!pending.empty())
+        {
+            const FileItem& item = *pending.front();
+            pending.pop_front();
+            const Index self = static_cast<Index>(owned->kind.size());
+            owned->kind.push_back(static_cast<NodeKind>(item.index()));
+            std::visit([&owned, &pending, self](const auto& fi) {
+                using FileItemType = std::remove_cvref_t<decltype(fi)>;
+                owned->name_offset.push_back(static_cast<std::uint32_t>(owned->names.size()));
+                owned->names.append(fi.GetName());
+                // children are numbered after everything already queued
+                const Index first = static_cast<Index>(owned->parent.size());
+                Index count = 0;
+                if constexpr (std::is_base_of_v<ContainerFileItem, FileItemType>)
+                {
+                    fi.Visit([&owned, &pending, self, &count](const FileItem& child) {
+                        pending.push_back(&child);
+                        owned->parent.push_back(self);
+                        ++count;
+                    });
+                }
+                owned->first_child.push_back(count ? first : kNone);
+                owned->child_count.push_back(count);
+                FileAttributes attributes;
+                if constexpr (std::is_same_v<FileItemType, File>)
+                    attributes = fi.GetAttributes();
+                owned->size.push_back(attributes.size);
+                owned->mtime.push_back(attributes.mtime);
+                owned->mode.push_back(attributes.mode);
+            }, static_cast<const FileItemVariant&>(item));
+        }
+        owned->name_offset.push_back(static_cast<std::uint32_t>(owned->names.size()));
+        m_columns = Columns{owned->kind, owned->parent, owned->first_child, owned->child_count, owned->name_offset, owned->names,
+            owned->size, owned->mtime, owned->mode};
+        m_storage = std::move(owned);
+    }
+    // Adopts columns that live in storage, which is kept alive as long as any copy of the tree.
+    FlatTree(const Columns& columns, std::shared_ptr<const void> storage)
+        : m_columns(columns), m_storage(std::move(storage)) {}
+
+    std::size_t Size() const { return m_columns.kind.size(); }
+    Node Root() const { return Node(*this, 0); }
+    NodeKind GetKind(Index i) const { return m_columns.kind[i]; }
+    std::string_view GetName(Index i) const
+    {
+        return m_columns.names.substr(m_columns.name_offset[i], m_columns.name_offset[i + 1] - m_columns.name_offset[i]);
+    }
+    FileAttributes GetAttributes(Index i) const { return FileAttributes{m_columns.size[i], m_columns.mtime[i], m_columns.mode[i]}; }
+    Index Parent(Index i) const { return m_columns.parent[i]; }
+    Index ChildCount(Index i) const { return m_columns.child_count[i]; }
+    Index Child(Index i, int idx) const
+    {
+        if (idx < 0 || static_cast<Index>(idx) >= m_columns.child_count[i]) throw NonExist{};
+        return m_columns.first_child[i] + static_cast<Index>(idx);
+    }
+    // The Path from the root to node i, so that (*this)[PathTo(i)].GetIndex() == i.
+    Path PathTo(Index i) const
+    {
+        Path path;
+        for (Index parent = m_columns.parent[i]; parent != kNone; i = parent, parent = m_columns.parent[i])
+            path.push_back(static_cast<int>(i - m_columns.first_child[parent]));
+        std::reverse(path.begin(), path.end());
+        return path;
+    }
+
+    // column access for scans
+    const Columns& GetColumns() const { return m_columns; }
+    std::span<const NodeKind> Kinds() const { return m_columns.kind; }
+    std::span<const Index> Parents() const { return m_columns.parent; }
+    std::string_view NameBlob() const { return m_columns.names; }
+    std::span<const std::uint64_t> Sizes() const { return m_columns.size; }
+    std::span<const std::int64_t> MTimes() const { return m_columns.mtime; }
+    std::span<const std::uint32_t> Modes() const { return m_columns.mode; }
+
+    // Sum of every file's size.
+    std::uint64_t TotalSize() const
+    {
+        std::uint64_t total = 0;
+        for (const std::uint64_t size : m_columns.size)
+            total += size;
+        return total;
+    }
+    // Number of files modified after mtime (containers have an mtime of 0).
+    std::size_t CountModifiedAfter(std::int64_t mtime) const
+    {
+        std::size_t count = 0;
+        for (const std::int64_t modified : m_columns.mtime)
+            count += modified > mtime;
+        return count;
+    }
+
+    Node operator[](const Path& path) const
+    {
+        Index current = 0;
+        for (int idx : path)
+            current = Child(current, idx);
+        return Node(*this, current);
+    }
+    // Same visiting order and visitor signature as FileItem::Recurse: fn(Node, const Path&).
+    template<class Fn>
+    void Recurse(Fn&& fn) const
+    {
+        Path path;
+        Recurse(fn, 0, path);
+    }
+    // Rebuilds a mutable FileItem for the subtree rooted at node.
+    FileItem Materialize(Index node = 0, FileItem::allocator_type alloc = {}) const
+    {
+        const std::string_view name = GetName(node);
+        if (GetKind(node) == NodeKind::File)
+            return File{name, GetAttributes(node), alloc};
+        std::pmr::vector<FileItem> contents(alloc);
+        contents.reserve(ChildCount(node));
+        for (Index c = 0; c < ChildCount(node); ++c)
+            contents.push_back(Materialize(m_columns.first_child[node] + c, alloc));
+        if (GetKind(node) == NodeKind::Drive)
+            return Drive{name.empty() ? 'a' : name[0], std::move(contents)};
+        return Directory{name, std::move(contents)};
+    }
+private:
+    struct OwnedColumns
+    {
+        std::vector<NodeKind>       kind;
+        std::vector<Index>          parent;
+        std::vector<Index>          first_child;
+        std::vector<Index>          child_count;
+        std::vector<std::uint32_t>  name_offset;
+        std::string                 names;
+        std::vector<std::uint64_t>  size;
+        std::vector<std::int64_t>   mtime;
+        std::vector<std::uint32_t>  mode;
+    };
+
+    template<class Fn>
+    void Recurse(Fn& fn, Index node, Path& path) const
+    {
+        fn(Node(*this, node), std::as_const(path));
+        const Index first = m_columns.first_child[node];
+        for (Index c = 0; c < m_columns.child_count[node]; ++c)
+        {
+            path.push_back(static_cast<int>(c));
+            Recurse(fn, first + c, path);
+            path.pop_back();
+        }
+    }
+
+    Columns                     m_columns;
+    std::shared_ptr<const void> m_storage;
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// Fast non-cryptographic 64-bit hashing, the wyhash construction (public domain): 64x64->128
+// multiplies fold 16 or 48 bytes per step, in the same class as XXH3 for speed and quality.
+class Hash64
+{
+    static constexpr std::uint64_t kSecret[4] = {0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull};
+
+    static std::uint64_t Mix(std::uint64_t a, std::uint64_t b)
+    {
+        const __uint128_t product = static_cast<__uint128_t>(a) * b;
+        return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+    }
+    static std::uint64_t Read64(const unsigned char* p)
+    {
+        std::uint64_t value;
+        std::memcpy(&value, p, sizeof value);
+        return value;
+    }
+    static std::uint64_t Read32(const unsigned char* p)
+    {
+        std::uint32_t value;
+        std::memcpy(&value, p, sizeof value);
+        return value;
+    }
+public:
+    static std::uint64_t Bytes(const void* data, std::size_t length, std::uint64_t seed = 0)
+    {
+        const auto* p = static_cast<const unsigned char*>(data);
+        seed ^= Mix(seed ^ kSecret[0], kSecret[1]);
+        std::uint64_t a = 0, b = 0;
+        if (length <= 16)
+        {
+            if (length >= 4)
+            {
+                const std::size_t step = (length >> 3) << 2;
+                a = (Read32(p) << 32) | Read32(p + step);
+                b = (Read32(p + length - 4) << 32) | Read32(p + length - 4 - step);
+            }
+            else if (length > 0)
+                a = (std::uint64_t{p[0]} << 16) | (std::uint64_t{p[length >> 1]} << 8) | p[length - 1];
+        }
+        else
+        {
+            std::size_t remaining = length;
+            if (remaining > 48)
+            {
+                std::uint64_t second = seed, third = seed;
+                do
+                {
+                    seed = Mix(Read64(p) ^ kSecret[1], Read64(p + 8) ^ seed);
+                    second = Mix(Read64(p + 16) ^ kSecret[2], Read64(p + 24) ^ second);
+                    third = Mix(Read64(p + 32) ^ kSecret[3], Read64(p + 40) ^ third);
+                    p += 48;
+                    remaining -= 48;
+                } while (remaining > 48);
+                seed ^= second ^ third;
+            }
+            for (; remaining > 16; remaining -= 16, p += 16)
+                seed = Mix(Read64(p) ^ kSecret[1], Read64(p + 8) ^ seed);
+            a = Read64(p + remaining - 16);
+            b = Read64(p + remaining - 8);
+        }
+        a ^= kSecret[1];
+        b ^= seed;
+        const __uint128_t product = static_cast<__uint128_t>(a) * b;
+        return Mix(static_cast<std::uint64_t>(product) ^ kSecret[0] ^ length, static_cast<std::uint64_t>(product >> 64) ^ kSecret[1]);
+    }
+    // Folds value into a running hash.
+    static std::uint64_t Combine(std::uint64_t hash, std::uint64_t value)
+    {
+        return Mix(hash ^ kSecret[2], value ^ kSecret[3]);
+    }
+};
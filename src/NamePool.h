@@ -0,0 +1,105 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Process-wide store of interned names. Each distinct name is stored once, NUL-terminated,
+// and is never freed; a node keeps only the 32-bit id. View() takes no lock and may run
+// concurrently with Intern().
+class NamePool
+{
+public:
+    using Id = std::uint32_t;
+    struct Stats { std::size_t names; std::size_t bytes; };
+
+    static NamePool& Global()
+    {
+        static NamePool pool;
+        return pool;
+    }
+
+    Id Intern(std::string_view name)
+    {
+        std::lock_guard lock(m_mutex);
+        if (const auto it = m_ids.find(name); it != m_ids.end())
+            return it->second;
+        const std::string_view stored = Store(name);
+        const Id id = m_count;
+        auto& block = m_blocks[id >> kBlockBits];
+        if (!block.load(std::memory_order_relaxed))
+            block.store(new std::string_view[kBlockSize], std::memory_order_release);
+        block.load(std::memory_order_relaxed)[id & (kBlockSize - 1)] = stored;
+        m_ids.emplace(stored, id);
+        ++m_count;
+        return id;
+    }
+    std::string_view View(Id id) const
+    {
+        return m_blocks[id >> kBlockBits].load(std::memory_order_acquire)[id & (kBlockSize - 1)];
+    }
+    Stats GetStats() const
+    {
+        std::lock_guard lock(m_mutex);
+        return Stats{m_count, m_bytes};
+    }
+
+    NamePool(const NamePool&) = delete;
+    NamePool& operator=(const NamePool&) = delete;
+    ~NamePool()
+    {
+        for (auto& block : m_blocks)
+            delete[] block.load(std::memory_order_relaxed);
+    }
+private:
+    static constexpr unsigned    kBlockBits = 16;
+    static constexpr std::size_t kBlockSize = std::size_t{1} << kBlockBits;
+    static constexpr std::size_t kChunkSize = 64 * 1024;
+
+    NamePool() = default;
+
+    std::string_view Store(std::string_view name)
+    {
+        m_bytes += name.size();
+        const std::size_t stored = name.size() + 1;
+        char* dest;
+        if (stored > kChunkSize)
+        {
+            // oversized names get a chunk of their own; keep the current chunk for the rest
+            m_large.push_back(std::make_unique<char[]>(stored));
+            dest = m_large.back().get();
+        }
+        else
+        {
+            if (stored > m_chunk_free)
+            {
+                m_chunks.push_back(std::make_unique<char[]>(kChunkSize));
+                m_chunk_free = kChunkSize;
+            }
+            dest = m_chunks.back().get() + (kChunkSize - m_chunk_free);
+            m_chunk_free -= stored;
+        }
+        std::memcpy(dest, name.data(), name.size());
+        dest[name.size()] = '\0';
+        return std::string_view{dest, name.size()};
+    }
+
+    mutable std::mutex                                  m_mutex;
+    std::unordered_map<std::string_view, Id>            m_ids;
+    std::vector<std::unique_ptr<char[]>>                m_chunks;
+    std::vector<std::unique_ptr<char[]>>                m_large;
+    std::size_t                                         m_chunk_free{0};
+    std::size_t                                         m_bytes{0};
+    Id                                                  m_count{0};
+    std::atomic<std::string_view*>                      m_blocks[std::size_t{1} << (32 - kBlockBits)]{};
+};
+
+// Tag for constructing a NamedFileItem whose name lives in the NamePool.
+struct Interned
+{
+    std::string_view name;
+};
@@ -0,0 +1,263 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILEEXAMPLE_NAME_SEARCH_AVX2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FILEEXAMPLE_NAME_SEARCH_NEON 1
+#endif
+#include "FileItem.h"
+#include "FlatTree.h"
+
+enum class NameMatch { Exact, Prefix, Suffix, Substring, Glob };
+// Vector uses AVX2 or NEON where the CPU has it and the scalar kernel otherwise.
+enum class NameKernel { Scalar, Vector };
+
+// "Every entry whose name matches" over a whole tree. Against a FlatTree the search scans
+// the name blob once for the pattern's literal text: a kernel compares its first and last
+// byte at 32 (AVX2) or 16 (NEON) positions per step, and each candidate is mapped to the
+// node whose name contains it and checked against the match kind. Prefix and exact misses
+// skip the rest of the name; substrings stop at the first hit in a name.
+//
+// Globs support '*' and '?'. Globs with one literal run ("*.cpp", "README*", "*cache*",
+// "Makefile") run as the equivalent Suffix/Prefix/Substring/Exact search; other globs use
+// their longest literal run to pick candidates and match the whole name against them.
+//
+// FindPaths(const FileItem&) is the scalar walk: one Recurse with a compare per name. The
+// pattern is not copied and must outlive the search.
+class NameSearch
+{
+public:
+    NameSearch(NameMatch match, std::string_view pattern) : m_match(match), m_literal(pattern)
+    {
+        if (match == NameMatch::Glob)
+            PlanGlob(pattern);
+    }
+
+    bool Matches(std::string_view name) const
+    {
+        if (m_glob)
+            return MatchesGlob(name);
+        switch (m_match)
+        {
+        case NameMatch::Exact:      return name == m_literal;
+        case NameMatch::Prefix:     return name.starts_with(m_literal);
+        case NameMatch::Suffix:     return name.ends_with(m_literal);
+        default:                    return name.find(m_literal) != std::string_view::npos;
+        }
+    }
+
+    // Matching nodes in index (breadth-first) order.
+    std::vector<FlatTree::Index> Search(const FlatTree& tree, NameKernel kernel = NameKernel::Vector) const
+    {
+        Candidates candidates(*this, tree);
+        if (m_literal.empty())
+        {
+            for (FlatTree::Index i = 0; i < tree.Size(); ++i)
+                if (Matches(tree.GetName(i)))
+                    candidates.hits.push_back(i);
+            return std::move(candidates.hits);
+        }
+        const std::string_view blob = tree.NameBlob();
+#if FILEEXAMPLE_NAME_SEARCH_AVX2
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        if (kernel == NameKernel::Vector && avx2)
+            ScanAvx2(blob, m_literal, candidates);
+        else
+            ScanScalar(blob, m_literal, 0, candidates);
+#elif FILEEXAMPLE_NAME_SEARCH_NEON
+        if (kernel == NameKernel::Vector)
+            ScanNeon(blob, m_literal, candidates);
+        else
+            ScanScalar(blob, m_literal, 0, candidates);
+#else
+        (void)kernel;
+        ScanScalar(blob, m_literal, 0, candidates);
+#endif
+        return std::move(candidates.hits);
+    }
+    std::vector<Path> FindPaths(const FlatTree& tree, NameKernel kernel = NameKernel::Vector) const
+    {
+        std::vector<Path> paths;
+        for (const FlatTree::Index i : Search(tree, kernel))
+            paths.push_back(tree.PathTo(i));
+        return paths;
+    }
+    // Matching paths in Recurse (depth-first) order.
+    std::vector<Path> FindPaths(const FileItem& root) const
+    {
+        std::vector<Path> paths;
+        root.Recurse([this, &paths](const auto& fi, const Path& path) {
+            if (Matches(fi.GetName()))
+                paths.push_back(path);
+        });
+        return paths;
+    }
+
+private:
+    // Receives the blob positions where the literal occurs and returns the position to
+    // resume scanning from, which is always past the one given.
+    struct Candidates
+    {
+        const NameSearch&               search;
+        std::span<const std::uint32_t>  offset;
+        std::string_view                blob;
+        FlatTree::Index                 node{0};
+        std::vector<FlatTree::Index>    hits;
+
+        Candidates(const NameSearch& search, const FlatTree& tree)
+            : search(search), offset(tree.GetColumns().name_offset), blob(tree.NameBlob()) {}
+
+        std::size_t operator()(std::size_t pos)
+        {
+            while (offset[node + 1] <= pos)
+                ++node;
+            const std::size_t begin = offset[node], end = offset[node + 1], length = search.m_literal.size();
+            // runs into the next name
+            if (pos + length > end)
+                return pos + 1;
+            bool hit;
+            if (search.m_glob)
+                hit = search.MatchesGlob(blob.substr(begin, end - begin));
+            else switch (search.m_match)
+            {
+            case NameMatch::Exact:      hit = pos == begin && pos + length == end; break;
+            case NameMatch::Prefix:     hit = pos == begin; break;
+            case NameMatch::Suffix:     hit = pos + length == end; break;
+            default:                    hit = true; break;
+            }
+            if (hit)
+                hits.push_back(node);
+            if (!hit && !search.m_glob && search.m_match == NameMatch::Suffix)
+                return end - length;
+            return end;
+        }
+    };
+
+    // '*' matches any run of bytes and '?' any one byte.
+    static bool MatchGlob(std::string_view name, std::string_view glob)
+    {
+        std::size_t n = 0, g = 0, star = std::string_view::npos, resume = 0;
+        while (n < name.size())
+        {
+            if (g < glob.size() && (glob[g] == '?' || glob[g] == name[n]))
+                ++n, ++g;
+            else if (g < glob.size() && glob[g] == '*')
+                star = g++, resume = n;
+            else if (star != std::string_view::npos)
+                g = star + 1, n = ++resume;
+            else
+                return false;
+        }
+        while (g < glob.size() && glob[g] == '*')
+            ++g;
+        return g == glob.size();
+    }
+
+    // The literal head and tail reject most names before the general match runs.
+    bool MatchesGlob(std::string_view name) const
+    {
+        return name.size() >= m_head.size() + m_tail.size() && name.starts_with(m_head) && name.ends_with(m_tail)
+            && MatchGlob(name, m_pattern);
+    }
+
+    void PlanGlob(std::string_view glob)
+    {
+        const std::size_t first = glob.find_first_not_of('*');
+        const std::size_t last = glob.find_last_not_of('*');
+        const std::string_view inner = first == std::string_view::npos ? std::string_view{} : glob.substr(first, last + 1 - first);
+        if (inner.find_first_of("*?") == std::string_view::npos)
+        {
+            const bool leading = glob.starts_with('*'), trailing = glob.ends_with('*');
+            m_match = leading && trailing ? NameMatch::Substring : leading ? NameMatch::Suffix : trailing ? NameMatch::Prefix : NameMatch::Exact;
+            m_literal = inner;
+            return;
+        }
+        m_glob = true;
+        m_pattern = glob;
+        m_head = glob.substr(0, glob.find_first_of("*?"));
+        m_tail = glob.substr(glob.find_last_of("*?") + 1);
+        m_literal = {};
+        for (std::size_t begin = 0; begin < glob.size();)
+        {
+            const std::size_t end = std::min(glob.find_first_of("*?", begin), glob.size());
+            if (end - begin > m_literal.size())
+                m_literal = glob.substr(begin, end - begin);
+            begin = end + 1;
+        }
+    }
+
+    template<class Fn>
+    static void ScanScalar(std::string_view blob, std::string_view literal, std::size_t from, Fn& fn)
+    {
+        for (std::size_t pos = blob.find(literal, from); pos != std::string_view::npos; pos = blob.find(literal, fn(pos)))
+            ;
+    }
+    static bool MiddleMatches(const char* at, std::string_view literal)
+    {
+        return literal.size() <= 2 || std::memcmp(at + 1, literal.data() + 1, literal.size() - 2) == 0;
+    }
+#if FILEEXAMPLE_NAME_SEARCH_AVX2
+    template<class Fn>
+    __attribute__((target("avx2"))) static void ScanAvx2(std::string_view blob, std::string_view literal, Fn& fn)
+    {
+        const char* data = blob.data();
+        const std::size_t length = literal.size();
+        const __m256i first = _mm256_set1_epi8(literal.front());
+        const __m256i last = _mm256_set1_epi8(literal.back());
+        std::size_t i = 0, resume = 0;
+        while (i + length + 31 <= blob.size())
+        {
+            const __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            const __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + length - 1));
+            auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last))));
+            for (; mask; mask &= mask - 1)
+            {
+                const std::size_t pos = i + static_cast<std::size_t>(std::countr_zero(mask));
+                if (pos >= resume && MiddleMatches(data + pos, literal))
+                    resume = fn(pos);
+            }
+            i = std::max(i + 32, resume);
+        }
+        ScanScalar(blob, literal, std::max(i, resume), fn);
+    }
+#elif FILEEXAMPLE_NAME_SEARCH_NEON
+    template<class Fn>
+    static void ScanNeon(std::string_view blob, std::string_view literal, Fn& fn)
+    {
+        const auto* data = reinterpret_cast<const std::uint8_t*>(blob.data());
+        const std::size_t length = literal.size();
+        const uint8x16_t first = vdupq_n_u8(static_cast<std::uint8_t>(literal.front()));
+        const uint8x16_t last = vdupq_n_u8(static_cast<std::uint8_t>(literal.back()));
+        std::size_t i = 0, resume = 0;
+        while (i + length + 15 <= blob.size())
+        {
+            const uint8x16_t equal = vandq_u8(vceqq_u8(vld1q_u8(data + i), first), vceqq_u8(vld1q_u8(data + i + length - 1), last));
+            // four mask bits per byte
+            std::uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+            for (; mask; mask &= ~(std::uint64_t{0xF} << (std::countr_zero(mask) & ~3)))
+            {
+                const std::size_t pos = i + static_cast<std::size_t>(std::countr_zero(mask) / 4);
+                if (pos >= resume && MiddleMatches(blob.data() + pos, literal))
+                    resume = fn(pos);
+            }
+            i = std::max(i + 16, resume);
+        }
+        ScanScalar(blob, literal, std::max(i, resume), fn);
+    }
+#endif
+
+    NameMatch           m_match;
+    std::string_view    m_literal;
+    std::string_view    m_pattern;
+    std::string_view    m_head;
+    std::string_view    m_tail;
+    bool                m_glob{false};
+};
@@ -0,0 +1,235 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "FileItem.h"
+
+// A stable name for a node: a slot in a NodeTable and the generation the slot had when the
+// handle was issued. Removing the node bumps the generation, so a stale handle is detected
+// with one compare, even after the slot has been reused.
+struct NodeHandle
+{
+    std::uint32_t   slot{~std::uint32_t{0}};
+    std::uint32_t   generation{0};
+
+    bool operator==(const NodeHandle&) const = default;
+};
+
+// Issues NodeHandles for every node of a tree and resolves them in O(1). Unlike a Path, a
+// handle survives inserts and removals among the node's siblings and ancestors' siblings.
+//
+// Children are stored by value, so an insert or removal moves the container's direct
+// children in memory (their own children stay put); the table re-points those, which costs
+// O(fan-out). Mutable() also re-points the children of any container on the way down that a
+// snapshot still shared. Change an attached tree only through its table: a structural change
+// made any other way leaves the table pointing at moved nodes. Rename and edit through
+// Mutable(), which also dirties the cached aggregates of the spine like operator[](Path).
+// Not thread-safe.
+class NodeTable
+{
+public:
+    explicit NodeTable(FileItem& root) : m_root(&root)
+    {
+        Adopt(root, kNoParent, 0);
+    }
+
+    NodeHandle Root() const { return HandleOf(0); }
+    std::size_t Size() const { return m_entries.size() - m_free.size(); }
+    bool IsValid(NodeHandle handle) const
+    {
+        return handle.slot < m_entries.size() && m_entries[handle.slot].generation == handle.generation;
+    }
+
+    // The node, or nullptr for a stale handle.
+    const FileItem* TryResolve(NodeHandle handle) const
+    {
+        return IsValid(handle) ? m_entries[handle.slot].node : nullptr;
+    }
+    const FileItem& Resolve(NodeHandle handle) const
+    {
+        if (const FileItem* node = TryResolve(handle))
+            return *node;
+        throw NonExist{};
+    }
+    // The node for writing. Walks the spine from the root, O(depth), to give every container
+    // on it its own children and mark their aggregates dirty.
+    FileItem& Mutable(NodeHandle handle)
+    {
+        Check(handle);
+        std::vector<std::uint32_t> spine;
+        for (std::uint32_t slot = handle.slot; slot != 0; slot = m_entries[slot].parent)
+            spine.push_back(slot);
+        FileItem* node = m_root;
+        for (auto it = spine.rbegin(); it != spine.rend(); ++it)
+        {
+            const Entry& child = m_entries[*it];
+            ContainerFileItem& container = *node->AsContainer();
+            const bool shared = container.IsShared();
+            node = container.TryGet(static_cast<int>(child.position));
+            if (shared)
+                Repoint(child.parent, container);
+        }
+        return *node;
+    }
+
+    NodeHandle Parent(NodeHandle handle) const
+    {
+        Check(handle);
+        const std::uint32_t parent = m_entries[handle.slot].parent;
+        return parent == kNoParent ? NodeHandle{} : HandleOf(parent);
+    }
+    NodeHandle Child(NodeHandle handle, int idx) const
+    {
+        Check(handle);
+        const auto& children = m_entries[handle.slot].children;
+        if (idx < 0 || static_cast<std::size_t>(idx) >= children.size())
+            throw NonExist{};
+        return HandleOf(children[static_cast<std::size_t>(idx)]);
+    }
+    NodeHandle Find(const Path& path) const
+    {
+        NodeHandle handle = Root();
+        for (int idx : path)
+            handle = Child(handle, idx);
+        return handle;
+    }
+    // The node's current positional Path.
+    Path PathOf(NodeHandle handle) const
+    {
+        Check(handle);
+        Path path;
+        for (std::uint32_t slot = handle.slot; slot != 0; slot = m_entries[slot].parent)
+            path.push_back(static_cast<int>(m_entries[slot].position));
+        std::reverse(path.begin(), path.end());
+        return path;
+    }
+
+    // Inserts child before position idx of parent's children (-1 appends) and returns its handle.
+    NodeHandle Insert(NodeHandle parent, FileItem child, int idx = -1)
+    {
+        ContainerFileItem* container = Mutable(parent).AsContainer();
+        if (!container)
+            throw NonExist{};
+        if (idx < 0)
+            idx = container->Size();
+        container->InsertChild(idx, std::move(child));
+        const std::uint32_t slot = Adopt(*std::as_const(*container).TryGet(idx), parent.slot, static_cast<std::uint32_t>(idx));
+        auto& siblings = m_entries[parent.slot].children;
+        siblings.insert(siblings.begin() + idx, slot);
+        Repoint(parent.slot, *container);
+        return HandleOf(slot);
+    }
+    // Removes the node and its subtree; every handle into it goes stale. The root cannot be
+    // removed.
+    void Remove(NodeHandle handle)
+    {
+        Check(handle);
+        const Entry& entry = m_entries[handle.slot];
+        if (entry.parent == kNoParent)
+            throw NonExist{};
+        const std::uint32_t parent = entry.parent, position = entry.position;
+        ContainerFileItem& container = *Mutable(HandleOf(parent)).AsContainer();
+        container.RemoveChild(static_cast<int>(position));
+        Release(handle.slot);
+        auto& siblings = m_entries[parent].children;
+        siblings.erase(siblings.begin() + position);
+        Repoint(parent, container);
+    }
+
+private:
+    static constexpr std::uint32_t kNoParent = ~std::uint32_t{0};
+
+    struct Entry
+    {
+        const FileItem*             node{nullptr};
+        std::uint32_t               parent{kNoParent};
+        // index among the parent's children
+        std::uint32_t               position{0};
+        std::uint32_t               generation{0};
+        // slots of the children, in order; empty for files
+        std::vector<std::uint32_t>  children;
+    };
+
+    NodeHandle HandleOf(std::uint32_t slot) const { return NodeHandle{slot, m_entries[slot].generation}; }
+    void Check(NodeHandle handle) const
+    {
+        if (!IsValid(handle))
+            throw NonExist{};
+    }
+
+    // Gives node and its subtree slots and returns node's. The subtree is walked with an
+    // explicit stack, so its depth is not bounded by the thread's.
+    std::uint32_t Adopt(const FileItem& node, std::uint32_t parent, std::uint32_t position)
+    {
+        const std::uint32_t top = Allocate(node, parent, position);
+        // slots whose children have no slots yet
+        std::vector<std::uint32_t> pending{top};
+        while (!pending.empty())
+        {
+            const std::uint32_t slot = pending.back();
+            pending.pop_back();
+            const ContainerFileItem* container = m_entries[slot].node->AsContainer();
+            if (!container)
+                continue;
+            std::vector<std::uint32_t> children;
+            children.reserve(static_cast<std::size_t>(container->Size()));
+            std::uint32_t child_position = 0;
+            container->Visit([this, slot, &children, &child_position](const FileItem& child) {
+                children.push_back(Allocate(child, slot, child_position++));
+            });
+            // the first child is expanded first, as the recursion did
+            pending.insert(pending.end(), children.rbegin(), children.rend());
+            m_entries[slot].children = std::move(children);
+        }
+        return top;
+    }
+    std::uint32_t Allocate(const FileItem& node, std::uint32_t parent, std::uint32_t position)
+    {
+        std::uint32_t slot;
+        if (m_free.empty())
+        {
+            slot = static_cast<std::uint32_t>(m_entries.size());
+            m_entries.emplace_back();
+        }
+        else
+        {
+            slot = m_free.back();
+            m_free.pop_back();
+        }
+        m_entries[slot].node = &node;
+        m_entries[slot].parent = parent;
+        m_entries[slot].position = position;
+        return slot;
+    }
+    // Retires slot and its subtree's slots, with an explicit stack like Adopt.
+    void Release(std::uint32_t slot)
+    {
+        std::vector<std::uint32_t> pending{slot};
+        while (!pending.empty())
+        {
+            const std::uint32_t current = pending.back();
+            pending.pop_back();
+            Entry& entry = m_entries[current];
+            pending.insert(pending.end(), entry.children.begin(), entry.children.end());
+            entry.children = {};
+            entry.node = nullptr;
+            ++entry.generation;
+            m_free.push_back(current);
+        }
+    }
+    // Points slot's children at where container now keeps them.
+    void Repoint(std::uint32_t slot, const ContainerFileItem& container)
+    {
+        const auto& children = m_entries[slot].children;
+        std::uint32_t position = 0;
+        container.Visit([this, &children, &position](const FileItem& child) {
+            Entry& entry = m_entries[children[position]];
+            entry.node = &child;
+            entry.position = position++;
+        });
+    }
+
+    FileItem*           m_root;
+    std::vector<Entry>  m_entries;
+    std::vector<std::uint32_t> m_free;
+};
@@ -0,0 +1,226 @@
+#pragma once
+#include <optional>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include "FileItem.h"
+#include "FlatTree.h"
+
+struct ParallelOptions
+{
+    // containers with fewer children are walked inline; larger ones are split into
+    // tasks of roughly this many children each
+    int grain_size{64};
+    // 0 uses every core
+    int max_threads{0};
+};
+
+// Like FileItem::Recurse, but children of large containers are handed to TBB's work-stealing
+// scheduler. The visitor is called concurrently for different nodes, in no particular order;
+// the path it receives belongs to the calling task and is only valid during the call.
+template<class Fn>
+class ParallelRecursion
+{
+    Fn&     m_fn;
+    int     m_grain;
+
+    void Visit(const FileItem& fi, Path& path) const
+    {
+        std::visit([this, &path](const auto& item) {
+            m_fn(item, std::as_const(path));
+            Children(item, path);
+        }, static_cast<const FileItemVariant&>(fi));
+    }
+    template<class FileItemType>
+    void Children(const FileItemType& item, Path& path) const
+    {
+        if constexpr (std::is_base_of_v<ContainerFileItem, FileItemType>)
+        {
+            const int size = item.Size();
+            if (size < m_grain)
+            {
+                for (int i = 0; i < size; ++i)
+                {
+                    path.push_back(i);
+                    Visit(item.Get(i), path);
+                    path.pop_back();
+                }
+                return;
+            }
+            tbb::parallel_for(tbb::blocked_range<int>(0, size, m_grain), [this, &item, &path](const tbb::blocked_range<int>& range) {
+                Path local = path;
+                for (int i = range.begin(); i != range.end(); ++i)
+                {
+                    local.push_back(i);
+                    Visit(item.Get(i), local);
+                    local.pop_back();
+                }
+            });
+        }
+    }
+public:
+    ParallelRecursion(Fn& fn, int grain) : m_fn(fn), m_grain(grain < 1 ? 1 : grain) {}
+    void Run(const FileItem& root) const
+    {
+        Path path;
+        Visit(root, path);
+    }
+};
+
+template<class Fn>
+void ParallelRecurse(const FileItem& root, Fn&& fn, ParallelOptions options = {})
+{
+    const ParallelRecursion<Fn> recursion(fn, options.grain_size);
+    if (options.max_threads > 0)
+        tbb::task_arena(options.max_threads).execute([&] { recursion.Run(root); });
+    else
+        recursion.Run(root);
+}
+
+// Parallel fold over every node: fn(T& local, item, path) accumulates into a per-thread T
+// seeded with identity, and the per-thread results are folded with combine(T, T) -> T.
+template<class T, class Fn, class Combine>
+T ParallelReduce(const FileItem& root, T identity, Fn&& fn, Combine&& combine, ParallelOptions options = {})
+{
+    tbb::enumerable_thread_specific<T> locals(identity);
+    ParallelRecurse(root, [&fn, &locals](const auto& item, const Path& path) {
+        fn(locals.local(), item, path);
+    }, options);
+    T result = identity;
+    locals.combine_each([&result, &combine](const T& local) { result = combine(std::move(result), local); });
+    return result;
+}
+
+// ContainerFileItem::Digest for the whole tree, hashing the children of large containers in
+// parallel. Subtrees whose digest is cached are not entered.
+inline std::uint64_t ParallelDigest(const FileItem& root, ParallelOptions options = {})
+{
+    struct Digester
+    {
+        int grain;
+        void Warm(const FileItem& fi) const
+        {
+            const ContainerFileItem* container = fi.AsContainer();
+            if (!container || container->IsDigestCached())
+                return;
+            const int size = container->Size();
+            if (size < grain)
+                for (int i = 0; i < size; ++i)
+                    Warm(container->Get(i));
+            else
+                tbb::parallel_for(tbb::blocked_range<int>(0, size, grain), [this, container](const tbb::blocked_range<int>& range) {
+                    for (int i = range.begin(); i != range.end(); ++i)
+                        Warm(container->Get(i));
+                });
+            // every child's digest is cached now, so this only hashes the names
+            container->Digest();
+        }
+    };
+    const Digester digester{options.grain_size < 1 ? 1 : options.grain_size};
+    if (options.max_threads > 0)
+        tbb::task_arena(options.max_threads).execute([&] { digester.Warm(root); });
+    else
+        digester.Warm(root);
+    return root.Digest();
+}
+
+// Destroys tree, tearing the children of large containers down in parallel: each task empties
+// its containers' subtrees before their child vectors go, so the frees of a large tree are
+// spread over the cores instead of running down one thread's recursion. Levels narrower than
+// the grain are taken apart with an explicit stack rather than by recursion, so a deep chain
+// costs a loop, and tasks are only forked for wide levels. Containers whose children another
+// copy still shares only drop their reference. The tree's resource must be safe to free into
+// from several threads (not a TreeArena; see TreeArena::Discard).
+inline void ParallelDestroy(FileItem&& tree, ParallelOptions options = {})
+{
+    struct Destroyer
+    {
+        int grain;
+        void Destroy(FileItem& fi) const
+        {
+            std::vector<std::pmr::vector<FileItem>> pending;
+            const auto take = [&pending](FileItem& node) {
+                ContainerFileItem* container = node.AsContainer();
+                if (!container || container->IsShared())
+                {
+                    const FileItem dying = std::move(node);
+                    return;
+                }
+                pending.push_back(container->TakeChildren());
+            };
+            take(fi);
+            while (!pending.empty())
+            {
+                std::pmr::vector<FileItem> children = std::move(pending.back());
+                pending.pop_back();
+                const int size = static_cast<int>(children.size());
+                if (size < grain)
+                    for (FileItem& child : children)
+                        take(child);
+                else
+                    tbb::parallel_for(tbb::blocked_range<int>(0, size, grain), [this, &children](const tbb::blocked_range<int>& range) {
+                        for (int i = range.begin(); i != range.end(); ++i)
+                            Destroy(children[static_cast<std::size_t>(i)]);
+                    });
+            }
+        }
+    };
+    const Destroyer destroyer{options.grain_size < 1 ? 1 : options.grain_size};
+    FileItem root = std::move(tree);
+    if (options.max_threads > 0)
+        tbb::task_arena(options.max_threads).execute([&] { destroyer.Destroy(root); });
+    else
+        destroyer.Destroy(root);
+}
+
+// FlatTree::Materialize, building the children of large containers in parallel; the result
+// is the same tree. alloc's resource is allocated from by several threads at once, so it must
+// be thread-safe: the default resource or a std::pmr::synchronized_pool_resource, not a
+// TreeArena.
+inline FileItem ParallelMaterialize(const FlatTree& flat, ParallelOptions options = {}, FileItem::allocator_type alloc = {})
+{
+    struct Builder
+    {
+        const FlatTree&             flat;
+        int                         grain;
+        FileItem::allocator_type    alloc;
+
+        FileItem Build(FlatTree::Index node) const
+        {
+            if (flat.GetKind(node) == NodeKind::File)
+                return flat.Materialize(node, alloc);
+            const int count = static_cast<int>(flat.ChildCount(node));
+            std::pmr::vector<FileItem> contents(alloc);
+            if (count < grain)
+            {
+                contents.reserve(static_cast<std::size_t>(count));
+                for (int c = 0; c < count; ++c)
+                    contents.push_back(Build(flat.Child(node, c)));
+            }
+            else
+            {
+                // tasks fill their slots in place; assigning through the variant skips
+                // FileItem::operator=, whose generation bump would have every task write one
+                // shared counter
+                contents.assign(static_cast<std::size_t>(count), FileItem(File{std::string_view{}, alloc}));
+                tbb::parallel_for(tbb::blocked_range<int>(0, count, grain), [this, node, &contents](const tbb::blocked_range<int>& range) {
+                    for (int c = range.begin(); c != range.end(); ++c)
+                        static_cast<FileItemVariant&>(contents[static_cast<std::size_t>(c)]) = static_cast<FileItemVariant&&>(Build(flat.Child(node, c)));
+                });
+            }
+            const std::string_view name = flat.GetName(node);
+            if (flat.GetKind(node) == NodeKind::Drive)
+                return Drive{name.empty() ? 'a' : name[0], std::move(contents)};
+            return Directory{name, std::move(contents)};
+        }
+    };
+    const Builder builder{flat, options.grain_size < 1 ? 1 : options.grain_size, alloc};
+    if (options.max_threads > 0)
+    {
+        std::optional<FileItem> built;
+        tbb::task_arena(options.max_threads).execute([&] { built.emplace(builder.Build(0)); });
+        return std::move(*built);
+    }
+    return builder.Build(0);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <unordered_map>
+#include "FileItem.h"
+
+struct PathHash
+{
+    std::size_t operator()(const Path& path) const noexcept
+    {
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        for (int idx : path)
+            hash = (hash ^ static_cast<std::uint32_t>(idx)) * 0x100000001b3ull;
+        return static_cast<std::size_t>(hash);
+    }
+};
+
+// Memoizes operator[](const Path&) on one root. Entries are dropped wholesale whenever the
+// StructureGeneration moves on, which includes a copy starting to share part of the tree;
+// renames do not invalidate positional paths. Failed lookups are not cached. Not
+// thread-safe; use one cache per thread.
+//
+// Hits are read-only: writing through a cached pointer would skip the walk from the root
+// that dirties each ancestor's Aggregates(), Digest() and name index. ResolveForWrite()
+// makes that walk, so it costs a full lookup but leaves the caches above it correct.
+class PathCache
+{
+public:
+    struct Stats
+    {
+        std::uint64_t hits{0};
+        std::uint64_t misses{0};
+        std::uint64_t invalidations{0};
+    };
+
+    explicit PathCache(FileItem& root, std::size_t capacity = 4096)
+        : m_root(&root), m_capacity(capacity), m_generation(StructureGeneration::Current()) {}
+
+    const FileItem& Resolve(const Path& path)
+    {
+        Revalidate();
+        if (const auto it = m_entries.find(path); it != m_entries.end())
+        {
+            ++m_stats.hits;
+            return *it->second;
+        }
+        ++m_stats.misses;
+        const FileItem& found = std::as_const(*m_root)[path];
+        Remember(path, found);
+        return found;
+    }
+    const FileItem& operator[](const Path& path) { return Resolve(path); }
+    // The node at path for changing it, reached from the root through operator[]; counted as
+    // a miss.
+    FileItem& ResolveForWrite(const Path& path)
+    {
+        ++m_stats.misses;
+        FileItem& found = (*m_root)[path];
+        // the walk may have unshared containers on the way, moving the generation on
+        Revalidate();
+        Remember(path, found);
+        return found;
+    }
+
+    // Drops every entry, e.g. after a structural change the generation cannot see.
+    void Clear()
+    {
+        m_entries.clear();
+        m_generation = StructureGeneration::Current();
+    }
+    const Stats& GetStats() const { return m_stats; }
+    std::size_t Size() const { return m_entries.size(); }
+private:
+    void Remember(const Path& path, const FileItem& found)
+    {
+        if (m_entries.size() >= m_capacity)
+            m_entries.clear();
+        m_entries.insert_or_assign(path, &found);
+    }
+    void Revalidate()
+    {
+        const std::uint64_t current = StructureGeneration::Current();
+        if (current == m_generation)
+            return;
+        if (!m_entries.empty())
+            ++m_stats.invalidations;
+        m_entries.clear();
+        m_generation = current;
+    }
+
+    FileItem*                                           m_root;
+    std::size_t                                         m_capacity;
+    std::uint64_t                                       m_generation;
+    std::unordered_map<Path, const FileItem*, PathHash> m_entries;
+    Stats                                               m_stats;
+};
@@ -0,0 +1,331 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "FileItem.h"
+
+// A very large directory with its children sorted by name and the names front-coded: each
+// block of about kBlockSize names stores its first name in full and every other name as the
+// length it shares with the previous name plus the rest. Sibling names such as log-2026-10-01,
+// log-2026-10-02, ... then cost a few bytes each, and Find() is a binary search over the
+// block heads followed by a short decode, with no hash index.
+//
+// The children are stored without names (the directory owns them), so a child reached
+// through Find() or Visit() reports an empty GetName() while it lives here; Visit() passes
+// each decoded name alongside its child. Positions are in name order, not insertion order.
+// Convert with SortedDirectory(Directory) and ToDirectory() at the boundary of code that
+// works on Paths.
+class SortedDirectory
+{
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+    static constexpr std::size_t kBlockSize = 16;
+
+    explicit SortedDirectory(std::string_view name, const allocator_type& alloc = {})
+        : m_name(name, alloc), m_names(alloc), m_blocks(alloc), m_children(alloc) {}
+    explicit SortedDirectory(const Directory& directory, const allocator_type& alloc = {})
+        : SortedDirectory(Directory(directory), alloc) {}
+    explicit SortedDirectory(Directory&& directory, const allocator_type& alloc = {})
+        : SortedDirectory(directory.GetName(), alloc)
+    {
+        std::vector<std::pair<std::string, FileItem*>> sorted;
+        sorted.reserve(static_cast<std::size_t>(directory.Size()));
+        directory.Visit([&sorted](FileItem& child) { sorted.emplace_back(std::string(child.GetName()), &child); });
+        // stable, so equal names keep their order and Find() still returns the first
+        std::ranges::stable_sort(sorted, {}, &std::pair<std::string, FileItem*>::first);
+        m_children.reserve(sorted.size());
+        std::vector<std::string_view> block;
+        for (auto& [child_name, child] : sorted)
+        {
+            m_children.push_back(Nameless(std::move(*child)));
+            block.push_back(child_name);
+            if (block.size() == kBlockSize)
+                AppendBlock(block);
+        }
+        if (!block.empty())
+            AppendBlock(block);
+        m_names.shrink_to_fit();
+    }
+
+    std::string_view GetName() const { return m_name; }
+    std::size_t Size() const { return m_children.size(); }
+    // Bytes taken by the encoded names and the block table.
+    std::size_t NameBytes() const { return m_names.size() + m_blocks.size() * sizeof(Block); }
+
+    // Position of the first child called name, or -1.
+    int IndexOf(std::string_view name) const
+    {
+        // equal names may run on from the block before the first head that is not smaller
+        for (std::size_t b = LastBlockWhere(std::less<>{}, name); b < m_blocks.size(); ++b)
+        {
+            const char* at = m_names.data() + m_blocks[b].offset;
+            // Every name decoded so far sorts before name and the last one shares matched
+            // bytes with it. A name sharing more with its predecessor than that is still
+            // smaller, one sharing less is larger, and only one sharing exactly matched needs
+            // its bytes compared, so nothing is copied.
+            std::size_t matched = 0;
+            for (std::size_t i = m_blocks[b].first; i < BlockEnd(b); ++i)
+            {
+                const std::size_t shared = ReadLength(at), rest = ReadLength(at);
+                const std::string_view suffix(at, rest);
+                at += rest;
+                if (shared > matched)
+                    continue;
+                if (shared < matched)
+                    return -1;
+                const std::string_view remaining = name.substr(matched);
+                const std::size_t common = static_cast<std::size_t>(std::ranges::mismatch(suffix, remaining).in1 - suffix.begin());
+                if (common == suffix.size() && common == remaining.size())
+                    return static_cast<int>(i);
+                // larger: a longer name with name as its prefix, or a larger byte
+                if (common == remaining.size() || (common < suffix.size()
+                    && static_cast<unsigned char>(suffix[common]) > static_cast<unsigned char>(remaining[common])))
+                    return -1;
+                matched += common;
+            }
+        }
+        return -1;
+    }
+    const FileItem* Find(std::string_view name) const
+    {
+        const int i = IndexOf(name);
+        return i < 0 ? nullptr : &m_children[static_cast<std::size_t>(i)];
+    }
+    FileItem* Find(std::string_view name)
+    {
+        const int i = IndexOf(name);
+        return i < 0 ? nullptr : &m_children[static_cast<std::size_t>(i)];
+    }
+    // Name of the child at position i; decodes from the start of its block.
+    std::string GetChildName(std::size_t i) const
+    {
+        const std::size_t b = BlockContaining(i);
+        Decoder decoder(*this, b);
+        for (std::size_t j = m_blocks[b].first; j < i; ++j)
+            decoder.Next();
+        return std::string(decoder.Next());
+    }
+
+    // fn(std::string_view name, [const] FileItem& child) for every child in name order. The
+    // name is only valid during the call.
+    template<class Fn>
+    void Visit(Fn&& fn) const { VisitImpl(*this, fn); }
+    template<class Fn>
+    void Visit(Fn&& fn) { VisitImpl(*this, fn); }
+
+    // Inserts child under name after any children of that name; re-encodes one block.
+    FileItem& Insert(std::string_view name, FileItem child)
+    {
+        const std::size_t b = LastBlockWhere(std::less_equal<>{}, name);
+        std::vector<std::string> names = DecodeBlock(b);
+        const auto at = std::ranges::upper_bound(names, name, std::less<>{});
+        const std::size_t position = (m_blocks.empty() ? 0 : m_blocks[b].first) + static_cast<std::size_t>(at - names.begin());
+        names.insert(at, std::string(name));
+        m_children.insert(m_children.begin() + static_cast<std::ptrdiff_t>(position), Nameless(std::move(child)));
+        ReplaceBlock(b, names, 1);
+        return m_children[position];
+    }
+    // Removes the first child called name; false if there is none.
+    bool Erase(std::string_view name)
+    {
+        const int i = IndexOf(name);
+        if (i < 0)
+            return false;
+        const std::size_t position = static_cast<std::size_t>(i), b = BlockContaining(position);
+        std::vector<std::string> names = DecodeBlock(b);
+        names.erase(names.begin() + static_cast<std::ptrdiff_t>(position - m_blocks[b].first));
+        m_children.erase(m_children.begin() + i);
+        ReplaceBlock(b, names, -1);
+        return true;
+    }
+
+    // A plain Directory with the children in name order and their names restored.
+    Directory ToDirectory(const allocator_type& alloc = {}) const
+    {
+        std::pmr::vector<FileItem> contents(alloc);
+        contents.reserve(m_children.size());
+        Visit([&contents](std::string_view name, const FileItem& child) {
+            FileItem& restored = contents.emplace_back(child);
+            if (NamedFileItem* named = restored.AsNamed())
+                named->SetName(name);
+        });
+        return Directory(m_name, std::move(contents));
+    }
+
+private:
+    struct Block
+    {
+        std::uint32_t   offset;     // into m_names
+        std::uint32_t   first;      // position of the block's first child
+    };
+
+    // Reads the names of one block in order; Next() returns a view into its buffer.
+    class Decoder
+    {
+        const char*     m_at;
+        std::string     m_current;
+    public:
+        Decoder(const SortedDirectory& directory, std::size_t block)
+            : m_at(directory.m_names.data() + directory.m_blocks[block].offset) {}
+        std::string_view Next()
+        {
+            const std::size_t shared = ReadLength(m_at);
+            const std::size_t rest = ReadLength(m_at);
+            m_current.resize(shared);
+            m_current.append(m_at, rest);
+            m_at += rest;
+            return m_current;
+        }
+    };
+
+    template<class Self, class Fn>
+    static void VisitImpl(Self& self, Fn& fn)
+    {
+        for (std::size_t b = 0; b < self.m_blocks.size(); ++b)
+        {
+            Decoder decoder(self, b);
+            for (std::size_t i = self.m_blocks[b].first; i < self.BlockEnd(b); ++i)
+                fn(decoder.Next(), self.m_children[i]);
+        }
+    }
+
+    FileItem Nameless(FileItem&& child) const
+    {
+        FileItem stored(std::allocator_arg, m_children.get_allocator(), std::move(child));
+        if (NamedFileItem* named = stored.AsNamed())
+            named->ReleaseName();
+        return stored;
+    }
+
+    // LEB128, so names shorter than 128 bytes take one length byte.
+    static void WriteLength(std::pmr::string& out, std::size_t length)
+    {
+        for (; length >= 0x80; length >>= 7)
+            out.push_back(static_cast<char>(0x80 | (length & 0x7F)));
+        out.push_back(static_cast<char>(length));
+    }
+    static std::size_t ReadLength(const char*& at)
+    {
+        std::size_t length = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            const auto byte = static_cast<unsigned char>(*at++);
+            length |= static_cast<std::size_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return length;
+        }
+    }
+    template<class Names>
+    static std::pmr::string Encode(const Names& names, const allocator_type& alloc)
+    {
+        std::pmr::string encoded(alloc);
+        std::string_view previous;
+        for (const auto& name : names)
+        {
+            const std::string_view current(name);
+            const std::size_t shared = static_cast<std::size_t>(std::ranges::mismatch(previous, current).in2 - current.begin());
+            WriteLength(encoded, shared);
+            WriteLength(encoded, current.size() - shared);
+            encoded.append(current.substr(shared));
+            previous = current;
+        }
+        return encoded;
+    }
+    void AppendBlock(std::vector<std::string_view>& names)
+    {
+        m_blocks.push_back(Block{static_cast<std::uint32_t>(m_names.size()), static_cast<std::uint32_t>(m_children.size() - names.size())});
+        m_names.append(Encode(names, m_names.get_allocator()));
+        names.clear();
+    }
+
+    std::size_t BlockEnd(std::size_t b) const
+    {
+        return b + 1 < m_blocks.size() ? m_blocks[b + 1].first : m_children.size();
+    }
+    std::size_t BlockBytes(std::size_t b) const
+    {
+        return (b + 1 < m_blocks.size() ? m_blocks[b + 1].offset : m_names.size()) - m_blocks[b].offset;
+    }
+    std::string_view Head(std::size_t b) const
+    {
+        const char* at = m_names.data() + m_blocks[b].offset;
+        ReadLength(at);
+        const std::size_t length = ReadLength(at);
+        return std::string_view(at, length);
+    }
+    // The last block whose head compares before name under compare, or 0 if none does.
+    template<class Compare>
+    std::size_t LastBlockWhere(Compare compare, std::string_view name) const
+    {
+        std::size_t low = 0, high = m_blocks.size();
+        while (high - low > 1)
+        {
+            const std::size_t middle = (low + high) / 2;
+            if (compare(Head(middle), name))
+                low = middle;
+            else
+                high = middle;
+        }
+        return low;
+    }
+    std::size_t BlockContaining(std::size_t position) const
+    {
+        const auto it = std::ranges::upper_bound(m_blocks, static_cast<std::uint32_t>(position), {}, &Block::first);
+        return static_cast<std::size_t>(it - m_blocks.begin()) - 1;
+    }
+    std::vector<std::string> DecodeBlock(std::size_t b) const
+    {
+        std::vector<std::string> names;
+        if (b == m_blocks.size())
+            return names;
+        Decoder decoder(*this, b);
+        for (std::size_t i = m_blocks[b].first; i < BlockEnd(b); ++i)
+            names.emplace_back(decoder.Next());
+        return names;
+    }
+    // Re-encodes block b (appending it if there are no blocks) as names, which has added
+    // more children than before; splits it in two when it has grown to twice kBlockSize and
+    // drops it when it is empty.
+    void ReplaceBlock(std::size_t b, const std::vector<std::string>& names, int added)
+    {
+        if (m_blocks.empty())
+        {
+            m_blocks.push_back(Block{0, 0});
+            m_names = Encode(names, m_names.get_allocator());
+            return;
+        }
+        const std::size_t offset = m_blocks[b].offset, old_bytes = BlockBytes(b);
+        std::pmr::string encoded(m_names.get_allocator());
+        Block second{0, 0};
+        const bool split = names.size() >= 2 * kBlockSize;
+        if (split)
+        {
+            const std::size_t half = names.size() / 2;
+            encoded = Encode(std::span(names).first(half), m_names.get_allocator());
+            second = Block{static_cast<std::uint32_t>(offset + encoded.size()), static_cast<std::uint32_t>(m_blocks[b].first + half)};
+            encoded.append(Encode(std::span(names).subspan(half), m_names.get_allocator()));
+        }
+        else
+            encoded = Encode(names, m_names.get_allocator());
+        m_names.replace(offset, old_bytes, encoded);
+        const auto delta = static_cast<std::int64_t>(encoded.size()) - static_cast<std::int64_t>(old_bytes);
+        for (std::size_t later = b + 1; later < m_blocks.size(); ++later)
+        {
+            m_blocks[later].offset = static_cast<std::uint32_t>(m_blocks[later].offset + delta);
+            m_blocks[later].first = static_cast<std::uint32_t>(m_blocks[later].first + added);
+        }
+        if (split)
+            m_blocks.insert(m_blocks.begin() + static_cast<std::ptrdiff_t>(b + 1), second);
+        else if (names.empty())
+            m_blocks.erase(m_blocks.begin() + static_cast<std::ptrdiff_t>(b));
+    }
+
+    std::pmr::string            m_name;
+    std::pmr::string            m_names;
+    std::pmr::vector<Block>     m_blocks;
+    std::pmr::vector<FileItem>  m_children;
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <new>
+#include "FileItem.h"
+
+// Bump allocator for building a whole tree in bulk. Nodes built with Allocator() keep their
+// children vectors and names in the arena; deallocation is a no-op and the memory is returned
+// when the arena is destroyed, so the arena must outlive every node built from it.
+// Memory released by renames or vector growth is not reused until then.
+class TreeArena
+{
+    std::pmr::monotonic_buffer_resource m_resource;
+public:
+    explicit TreeArena(std::size_t initial_size = 64 * 1024, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : m_resource(initial_size, upstream) {}
+    TreeArena(const TreeArena&) = delete;
+    TreeArena& operator=(const TreeArena&) = delete;
+
+    std::pmr::memory_resource* Resource() { return &m_resource; }
+    FileItem::allocator_type Allocator() { return FileItem::allocator_type{&m_resource}; }
+
+    std::pmr::vector<FileItem> MakeContents(std::size_t reserve = 0)
+    {
+        std::pmr::vector<FileItem> contents(Allocator());
+        contents.reserve(reserve);
+        return contents;
+    }
+    // Copies or moves a tree into the arena.
+    template<class FileItemType>
+    FileItem Adopt(FileItemType&& item)
+    {
+        return FileItem(std::allocator_arg, Allocator(), std::forward<FileItemType>(item));
+    }
+    // Drops tree without running its destructors, so even a very large tree goes in O(1):
+    // everything it owns (child blocks, vectors, names and name indexes) is in the arena and
+    // is freed in bulk when the arena is destroyed. A container built in any other resource is
+    // destroyed normally. Snapshots of tree in the arena stay valid.
+    void Discard(FileItem&& tree)
+    {
+        const ContainerFileItem* container = tree.AsContainer();
+        if (!container || container->GetAllocator() != Allocator())
+        {
+            const FileItem dying = std::move(tree);
+            return;
+        }
+        // the root node itself moves into arena memory that nothing will destroy
+        new (m_resource.allocate(sizeof(FileItem), alignof(FileItem))) FileItem(std::move(tree));
+    }
+};
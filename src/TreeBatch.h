@@ -0,0 +1,129 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "FileItem.h"
+
+// A list of (Path, operation) pairs applied to a tree in one pass. Operations are sorted by
+// path, so each shared prefix is resolved once rather than once per operation, and the whole
+// batch is checked before anything is changed: Apply() either performs every operation or
+// throws NonExist/CannotRename and leaves the tree as it was.
+//
+// Paths refer to the tree as it was before the batch. Inserts append to their container in
+// the order they were added, so they never move existing nodes' positions.
+class TreeBatch
+{
+    // Paths and new names are packed into two buffers, so a batch of renames costs no
+    // allocation per operation and sorting moves only these records.
+    struct Operation
+    {
+        std::uint32_t   path_offset;
+        std::uint32_t   path_length;
+        // offset into m_names for renames, index into m_children for inserts
+        std::uint32_t   argument;
+        std::uint32_t   name_length;
+        bool            insert;
+    };
+
+    // Resolves a sequence of paths, reusing the nodes on the prefix shared with the previous
+    // one. Only valid while none of the nodes on that prefix is moved.
+    template<class Node>
+    class PrefixResolver
+    {
+        std::vector<Node*>          m_nodes;
+        std::span<const int>        m_path;
+    public:
+        explicit PrefixResolver(Node& root) : m_nodes{&root} {}
+        Node& Resolve(std::span<const int> path)
+        {
+            const auto mismatch = std::mismatch(m_path.begin(), m_path.end(), path.begin(), path.end());
+            const std::size_t shared = static_cast<std::size_t>(mismatch.first - m_path.begin());
+            m_nodes.resize(shared + 1);
+            for (std::size_t i = shared; i < path.size(); ++i)
+                m_nodes.push_back(&(*m_nodes.back())[path[i]]);
+            m_path = path;
+            return *m_nodes.back();
+        }
+    };
+
+    std::span<const int> PathOf(const Operation& operation) const
+    {
+        return std::span<const int>(m_paths).subspan(operation.path_offset, operation.path_length);
+    }
+    void Add(std::span<const int> path, std::uint32_t argument, std::uint32_t name_length, bool insert)
+    {
+        const Operation added{static_cast<std::uint32_t>(m_paths.size()), static_cast<std::uint32_t>(path.size()), argument, name_length, insert};
+        m_paths.insert(m_paths.end(), path.begin(), path.end());
+        if (!m_operations.empty() && std::ranges::lexicographical_compare(PathOf(added), PathOf(m_operations.back())))
+            m_sorted = false;
+        m_operations.push_back(added);
+    }
+
+    std::vector<Operation>  m_operations;
+    std::vector<int>        m_paths;
+    std::string             m_names;
+    std::vector<FileItem>   m_children;
+    bool                    m_sorted{true};
+public:
+    TreeBatch& Rename(std::span<const int> path, std::string_view new_name)
+    {
+        Add(path, static_cast<std::uint32_t>(m_names.size()), static_cast<std::uint32_t>(new_name.size()), false);
+        m_names.append(new_name);
+        return *this;
+    }
+    // Appends child to the container at parent.
+    TreeBatch& Insert(std::span<const int> parent, FileItem child)
+    {
+        Add(parent, static_cast<std::uint32_t>(m_children.size()), 0, true);
+        m_children.push_back(std::move(child));
+        return *this;
+    }
+    // Makes room for that many more operations, with paths of about path_length.
+    void Reserve(std::size_t operations, std::size_t path_length = 4)
+    {
+        m_operations.reserve(m_operations.size() + operations);
+        m_paths.reserve(m_paths.size() + operations * path_length);
+    }
+    std::size_t Size() const { return m_operations.size(); }
+    bool Empty() const { return m_operations.empty(); }
+
+    // Applies and clears the batch. On failure the batch is left intact.
+    void Apply(FileItem& root)
+    {
+        // insert order within one container is preserved by the stable sort
+        if (!m_sorted)
+            std::stable_sort(m_operations.begin(), m_operations.end(), [this](const Operation& a, const Operation& b) {
+                return std::ranges::lexicographical_compare(PathOf(a), PathOf(b));
+            });
+        m_sorted = true;
+
+        PrefixResolver<const FileItem> check(root);
+        for (const Operation& operation : m_operations)
+        {
+            const FileItem& target = check.Resolve(PathOf(operation));
+            if (operation.insert && !target.IsContainer())
+                throw NonExist{};
+            if (!operation.insert && !target.IsNamed())
+                throw CannotRename{};
+        }
+
+        // An insert only moves the children of its own container, and every operation below
+        // that container sorts after it, so no resolved node is invalidated.
+        PrefixResolver<FileItem> apply(root);
+        for (const Operation& operation : m_operations)
+        {
+            FileItem& target = apply.Resolve(PathOf(operation));
+            if (!operation.insert)
+                target.Rename(std::string_view(m_names).substr(operation.argument, operation.name_length));
+            else
+                target.AsContainer()->AddChild(std::move(m_children[operation.argument]));
+        }
+        m_operations.clear();
+        m_paths.clear();
+        m_names.clear();
+        m_children.clear();
+    }
+};
@@ -0,0 +1,262 @@
+#pragma once
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <utility>
+#include <vector>
+#include "FileItem.h"
+
+// A lazily evaluated sequence in the style of C++23 std::generator: the coroutine runs only
+// as far as the next co_yield each time the iterator is advanced. The yielded value is only
+// valid until then. An exception thrown by the coroutine propagates out of begin() or ++.
+template<class T>
+class Generator
+{
+public:
+    struct promise_type
+    {
+        const T*            current{nullptr};
+        std::exception_ptr  error;
+
+        Generator get_return_object() { return Generator{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(const T& value) noexcept
+        {
+            current = std::addressof(value);
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { error = std::current_exception(); }
+        // generators only yield
+        template<class U>
+        void await_transform(U&&) = delete;
+    };
+
+    class iterator
+    {
+        std::coroutine_handle<promise_type> m_handle;
+    public:
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        explicit iterator(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+        const T& operator*() const { return *m_handle.promise().current; }
+        const T* operator->() const { return m_handle.promise().current; }
+        iterator& operator++()
+        {
+            Resume(m_handle);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+        bool operator==(std::default_sentinel_t) const { return !m_handle || m_handle.done(); }
+    };
+
+    Generator(Generator&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    Generator& operator=(Generator&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+    ~Generator()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    // Runs to the first value; call once.
+    iterator begin()
+    {
+        Resume(m_handle);
+        return iterator{m_handle};
+    }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    explicit Generator(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+    static void Resume(std::coroutine_handle<promise_type> handle)
+    {
+        handle.resume();
+        if (handle.promise().error)
+            std::rethrow_exception(std::exchange(handle.promise().error, {}));
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// A node reached by WalkGenerator(); as with Recurse, the path buffer is shared by the whole
+// walk.
+struct WalkedNode
+{
+    const FileItem& node;
+    const Path&     path;
+};
+
+// Every node under root in Recurse order, one per step of the iterator, so the caller can
+// stop, interleave other work or hand nodes on as it goes. The stack of the walk lives in
+// the coroutine frame, so depth is bounded by the heap. Do not change the tree while a walk
+// is in progress.
+inline Generator<WalkedNode> WalkGenerator(const FileItem& root)
+{
+    struct Frame
+    {
+        const ContainerFileItem*    container;
+        int                         next;
+    };
+    Path path;
+    co_yield WalkedNode{root, path};
+    std::vector<Frame> stack;
+    if (const ContainerFileItem* container = root.AsContainer())
+        stack.push_back(Frame{container, 0});
+    while (!stack.empty())
+    {
+        Frame& top = stack.back();
+        if (top.next == top.container->Size())
+        {
+            stack.pop_back();
+            // the root's frame is the only one without an index on the path
+            if (!path.empty())
+                path.pop_back();
+            continue;
+        }
+        const int idx = top.next++;
+        const FileItem& child = top.container->Get(idx);
+        path.push_back(idx);
+        co_yield WalkedNode{child, path};
+        if (const ContainerFileItem* container = child.AsContainer())
+            stack.push_back(Frame{container, 0});
+        else
+            path.pop_back();
+    }
+}
+
+// The return type of a visitor coroutine for WalkAsync. It starts suspended and is started by
+// the walk, and it frees itself when it finishes, on whichever thread resumed it last.
+class AsyncVisit
+{
+public:
+    // What WalkAsync tracks for every visit it has started.
+    class Owner
+    {
+    public:
+        virtual void Finished(std::exception_ptr error) noexcept = 0;
+    protected:
+        ~Owner() = default;
+    };
+
+    struct promise_type
+    {
+        Owner*              owner{nullptr};
+        std::exception_ptr  error;
+
+        AsyncVisit get_return_object() { return AsyncVisit{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+            {
+                Owner* owner = handle.promise().owner;
+                std::exception_ptr error = std::move(handle.promise().error);
+                handle.destroy();
+                owner->Finished(std::move(error));
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    AsyncVisit(AsyncVisit&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    AsyncVisit& operator=(AsyncVisit&&) = delete;
+    // a visit that was never started is dropped
+    ~AsyncVisit()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    // Runs the visit until its first suspension; owner->Finished() is called when it ends.
+    void Start(Owner& owner)
+    {
+        m_handle.promise().owner = &owner;
+        std::exchange(m_handle, {}).resume();
+    }
+
+private:
+    explicit AsyncVisit(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// Walks the tree and starts visitor(const FileItem& node, Path path) -> AsyncVisit for every
+// node, with at most max_in_flight visits unfinished at once: when that many are waiting on
+// their I/O, the walk waits for one of them to finish. Returns when every visit has finished,
+// rethrowing the first exception a visit threw. Visits may finish on any thread; the tree
+// must outlive them and not change meanwhile.
+template<class Visitor>
+void WalkAsync(const FileItem& root, Visitor&& visitor, std::ptrdiff_t max_in_flight)
+{
+    class Tracker final : public AsyncVisit::Owner
+    {
+        std::counting_semaphore<>   m_slots;
+        std::mutex                  m_mutex;
+        std::condition_variable     m_idle;
+        std::size_t                 m_running{0};
+        std::exception_ptr          m_error;
+    public:
+        explicit Tracker(std::ptrdiff_t slots) : m_slots(slots < 1 ? 1 : slots) {}
+        void Acquire()
+        {
+            m_slots.acquire();
+            std::lock_guard lock(m_mutex);
+            ++m_running;
+        }
+        void Finished(std::exception_ptr error) noexcept override
+        {
+            std::lock_guard lock(m_mutex);
+            if (error && !m_error)
+                m_error = std::move(error);
+            // everything under the lock: Wait() may return and destroy the tracker right after
+            m_slots.release();
+            if (--m_running == 0)
+                m_idle.notify_all();
+        }
+        void Wait()
+        {
+            std::unique_lock lock(m_mutex);
+            m_idle.wait(lock, [this] { return m_running == 0; });
+            if (m_error)
+                std::rethrow_exception(m_error);
+        }
+    };
+
+    Tracker tracker(max_in_flight);
+    try
+    {
+        for (const WalkedNode& walked : WalkGenerator(root))
+        {
+            // the visit does not run until Start, so take its slot only once it exists: a
+            // visitor that throws here has nothing in flight to wait for
+            AsyncVisit visit = visitor(walked.node, Path(walked.path));
+            tracker.Acquire();
+            visit.Start(tracker);
+        }
+    }
+    catch (...)
+    {
+        tracker.Wait();
+        throw;
+    }
+    tracker.Wait();
+}
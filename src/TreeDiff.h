@@ -0,0 +1,193 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "FileItem.h"
+
+// One difference between two trees. An added or removed container is reported once, not
+// once per node below it.
+struct TreeChange
+{
+    enum class Kind { Added, Removed, Renamed };
+
+    Kind    kind;
+    // the entry's path in the old tree; empty when added
+    Path    before;
+    // and in the new tree; empty when removed
+    Path    after;
+
+    bool operator==(const TreeChange&) const = default;
+};
+
+struct DiffOptions
+{
+    // also skip containers whose digests match; a 64-bit collision would hide a change
+    bool compare_digests{false};
+};
+
+// What changed from one tree to another, typically yesterday's snapshot and today's tree.
+// Containers whose children are still shared (today's tree was copied from the snapshot and
+// that part not written since) are skipped without being looked at, so after a few edits
+// the cost is the fan-out along the edited spines, not the size of the tree. Trees that share
+// nothing are compared in full, unless compare_digests is set: then containers with equal
+// Merkle digests (ContainerFileItem::Digest) are skipped too. The first such diff hashes both
+// trees; later ones rehash only what changed, since digests are cached.
+//
+// Children are matched by name. Of the rest, a container still sharing its children with
+// one on the other side (with compare_digests: of equal digest) is a rename, and so is a pair
+// of the same kind left at the same position; anything else is removed and added. Depth is
+// bounded by the heap, not the stack.
+class TreeDiff
+{
+public:
+    struct Stats
+    {
+        // pairs of containers whose children were compared
+        std::size_t compared{0};
+        // pairs skipped because they share their children or digests
+        std::size_t shared{0};
+    };
+
+    TreeDiff(const FileItem& before, const FileItem& after, DiffOptions options = {}) : m_options(options)
+    {
+        Compare(before, after);
+    }
+    const std::vector<TreeChange>& Changes() const { return m_changes; }
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    static constexpr int kUnmatched = -1;
+
+    // A pair of containers whose children have been matched; next is the old child to report.
+    struct Frame
+    {
+        const ContainerFileItem*    old_children;
+        const ContainerFileItem*    new_children;
+        std::vector<int>            partner;
+        std::vector<bool>           taken;
+        int                         next{0};
+    };
+
+    // Depth-first over the matched pairs with an explicit stack, so that deep trees do not
+    // recurse; the paths grow and shrink with it.
+    void Compare(const FileItem& before, const FileItem& after)
+    {
+        Path before_path, after_path;
+        std::vector<Frame> stack;
+        Enter(before, after, stack);
+        while (!stack.empty())
+        {
+            Frame& top = stack.back();
+            if (top.next == top.old_children->Size())
+            {
+                for (int j = 0; j < top.new_children->Size(); ++j)
+                    if (!top.taken[static_cast<std::size_t>(j)])
+                    {
+                        after_path.push_back(j);
+                        m_changes.push_back(TreeChange{TreeChange::Kind::Added, {}, after_path});
+                        after_path.pop_back();
+                    }
+                stack.pop_back();
+                // the pair's own indices, pushed when it was entered
+                if (!stack.empty())
+                {
+                    before_path.pop_back();
+                    after_path.pop_back();
+                }
+                continue;
+            }
+            const int i = top.next++;
+            const int j = top.partner[static_cast<std::size_t>(i)];
+            before_path.push_back(i);
+            if (j == kUnmatched)
+            {
+                m_changes.push_back(TreeChange{TreeChange::Kind::Removed, before_path, {}});
+                before_path.pop_back();
+                continue;
+            }
+            after_path.push_back(j);
+            const FileItem& old_child = top.old_children->Get(i);
+            const FileItem& new_child = top.new_children->Get(j);
+            if (old_child.GetName() != new_child.GetName())
+                m_changes.push_back(TreeChange{TreeChange::Kind::Renamed, before_path, after_path});
+            // top is not used past here: Enter may grow the stack
+            if (!Enter(old_child, new_child, stack))
+            {
+                after_path.pop_back();
+                before_path.pop_back();
+            }
+        }
+    }
+
+    // Matches the children of a pair of containers and pushes the pair, unless there is
+    // nothing to compare.
+    bool Enter(const FileItem& before, const FileItem& after, std::vector<Frame>& stack)
+    {
+        const ContainerFileItem* old_container = before.AsContainer();
+        const ContainerFileItem* new_container = after.AsContainer();
+        if (!old_container || !new_container)
+            return false;
+        if (old_container->SharesChildrenWith(*new_container)
+            || (m_options.compare_digests && old_container->Digest() == new_container->Digest()))
+        {
+            ++m_stats.shared;
+            return false;
+        }
+        ++m_stats.compared;
+        const ContainerFileItem& old_children = *old_container;
+        const ContainerFileItem& new_children = *new_container;
+        const int old_size = old_children.Size(), new_size = new_children.Size();
+        std::vector<int> partner(static_cast<std::size_t>(old_size), kUnmatched);
+        std::vector<bool> taken(static_cast<std::size_t>(new_size), false);
+        const auto pair = [&partner, &taken](int i, int j) {
+            partner[static_cast<std::size_t>(i)] = j;
+            taken[static_cast<std::size_t>(j)] = true;
+        };
+        // by name; most children have not moved, which saves building the name index
+        for (int i = 0; i < old_size; ++i)
+        {
+            const std::string_view name = old_children.Get(i).GetName();
+            int j = i < new_size && new_children.Get(i).GetName() == name ? i : new_children.Find(name);
+            if (j != kUnmatched && !taken[static_cast<std::size_t>(j)] && old_children.Get(i).index() == new_children.Get(j).index())
+                pair(i, j);
+        }
+        // renamed containers, recognized by their shared children (the address of the first
+        // child is the same on both sides), or with compare_digests by equal digests; the
+        // unmatched new ones are keyed so each old one costs one probe
+        std::unordered_multimap<std::uint64_t, int> unmatched;
+        const auto key = [this](const ContainerFileItem& container) {
+            return m_options.compare_digests ? container.Digest() : reinterpret_cast<std::uintptr_t>(&container.Get(0));
+        };
+        for (int j = 0; j < new_size; ++j)
+            if (const ContainerFileItem* new_child = new_children.Get(j).AsContainer(); new_child && new_child->Size() > 0 && !taken[static_cast<std::size_t>(j)])
+                unmatched.emplace(key(*new_child), j);
+        for (int i = 0; i < old_size && !unmatched.empty(); ++i)
+        {
+            const ContainerFileItem* old_child = old_children.Get(i).AsContainer();
+            if (partner[static_cast<std::size_t>(i)] != kUnmatched || !old_child || old_child->Size() == 0)
+                continue;
+            const auto [first, last] = unmatched.equal_range(key(*old_child));
+            // the first such container in child order, as a scan would find
+            auto best = last;
+            for (auto it = first; it != last; ++it)
+                if (!taken[static_cast<std::size_t>(it->second)] && (best == last || it->second < best->second))
+                    best = it;
+            if (best != last)
+            {
+                pair(i, best->second);
+                unmatched.erase(best);
+            }
+        }
+        // renamed in place
+        for (int i = 0; i < std::min(old_size, new_size); ++i)
+            if (partner[static_cast<std::size_t>(i)] == kUnmatched && !taken[static_cast<std::size_t>(i)]
+                && old_children.Get(i).index() == new_children.Get(i).index())
+                pair(i, i);
+        stack.push_back(Frame{old_container, new_container, std::move(partner), std::move(taken)});
+        return true;
+    }
+
+    DiffOptions             m_options;
+    std::vector<TreeChange> m_changes;
+    Stats                   m_stats;
+};
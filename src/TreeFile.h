@@ -0,0 +1,229 @@
+#pragma once
+#include <cstring>
+#include <fcntl.h>
+#include <optional>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "FlatTree.h"
+
+struct BadTreeFile : std::runtime_error {BadTreeFile(const std::string& why):std::runtime_error("Bad tree file: " + why){}};
+
+// On-disk layout of a FlatTree, little-endian, every section 8-byte aligned:
+//   header | kind[n] | parent[n] | first_child[n] | child_count[n] | name_offset[n+1] | names
+//          | size[n] | mtime[n] | mode[n]
+// Readers reject any other magic or version; version 1 files had no attribute columns.
+struct TreeFileHeader
+{
+    static constexpr char           kMagic[8] = {'F','I','T','R','E','E','\0','\0'};
+    static constexpr std::uint32_t  kVersion = 2;
+
+    char            magic[8];
+    std::uint32_t   version;
+    std::uint32_t   node_count;
+    std::uint64_t   name_bytes;
+    std::uint64_t   kind_offset;
+    std::uint64_t   parent_offset;
+    std::uint64_t   first_child_offset;
+    std::uint64_t   child_count_offset;
+    std::uint64_t   name_offset_offset;
+    std::uint64_t   names_offset;
+    std::uint64_t   size_offset;
+    std::uint64_t   mtime_offset;
+    std::uint64_t   mode_offset;
+    std::uint64_t   file_size;
+};
+
+class TreeFile
+{
+    static constexpr std::uint64_t Align(std::uint64_t offset) { return (offset + 7) & ~std::uint64_t{7}; }
+
+    static TreeFileHeader Layout(std::uint32_t nodes, std::uint64_t name_bytes)
+    {
+        TreeFileHeader header{};
+        std::memcpy(header.magic, TreeFileHeader::kMagic, sizeof header.magic);
+        header.version = TreeFileHeader::kVersion;
+        header.node_count = nodes;
+        header.name_bytes = name_bytes;
+        std::uint64_t offset = Align(sizeof(TreeFileHeader));
+        const auto place = [&offset](std::uint64_t bytes) { const std::uint64_t at = offset; offset = Align(offset + bytes); return at; };
+        header.kind_offset = place(nodes * sizeof(NodeKind));
+        header.parent_offset = place(nodes * sizeof(FlatTree::Index));
+        header.first_child_offset = place(nodes * sizeof(FlatTree::Index));
+        header.child_count_offset = place(nodes * sizeof(FlatTree::Index));
+        header.name_offset_offset = place((nodes + std::uint64_t{1}) * sizeof(std::uint32_t));
+        header.names_offset = place(name_bytes);
+        header.size_offset = place(nodes * sizeof(std::uint64_t));
+        header.mtime_offset = place(nodes * sizeof(std::int64_t));
+        header.mode_offset = place(nodes * sizeof(std::uint32_t));
+        header.file_size = offset;
+        return header;
+    }
+
+    // unmapped when the last FlatTree copy referring to it goes away
+    class Mapping
+    {
+        void*       m_data;
+        std::size_t m_size;
+    public:
+        Mapping(void* data, std::size_t size) : m_data(data), m_size(size) {}
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+        ~Mapping() { ::munmap(m_data, m_size); }
+        const char* Data() const { return static_cast<const char*>(m_data); }
+    };
+
+    // True when every link and name range stays inside the sections and the links form the
+    // breadth-first tree FlatTree assumes: each node's children come after it, in one range
+    // whose parent entries point back at it, and together they claim every node but the root
+    // exactly once. That also bounds every walk over the tree: none can loop.
+    static bool LinksAreSound(const FlatTree::Columns& columns)
+    {
+        const std::uint64_t nodes = columns.kind.size();
+        if (columns.name_offset[0] != 0 || columns.name_offset[nodes] != columns.names.size() || columns.parent[0] != FlatTree::kNone)
+            return false;
+        std::uint64_t claimed = 0;
+        for (std::uint64_t i = 0; i < nodes; ++i)
+        {
+            if (columns.kind[i] > NodeKind::Directory || columns.name_offset[i] > columns.name_offset[i + 1])
+                return false;
+            const std::uint64_t count = columns.child_count[i];
+            if (count == 0)
+                continue;
+            const std::uint64_t first = columns.first_child[i];
+            if (columns.kind[i] == NodeKind::File || first <= i || first + count > nodes)
+                return false;
+            for (std::uint64_t c = first; c < first + count; ++c)
+                if (columns.parent[c] != i)
+                    return false;
+            claimed += count;
+        }
+        return claimed == nodes - 1;
+    }
+
+    template<class T>
+    static std::span<const T> Section(const char* base, std::uint64_t offset, std::size_t count)
+    {
+        return std::span<const T>(reinterpret_cast<const T*>(base + offset), count);
+    }
+public:
+    static void Save(const FlatTree& tree, const std::string& filename)
+    {
+        const FlatTree::Columns& columns = tree.GetColumns();
+        const TreeFileHeader header = Layout(static_cast<std::uint32_t>(columns.kind.size()), columns.names.size());
+        std::string image(header.file_size, '\0');
+        std::memcpy(image.data(), &header, sizeof header);
+        const auto put = [&image](std::uint64_t offset, const void* data, std::size_t bytes) {
+            if (bytes) std::memcpy(image.data() + offset, data, bytes);
+        };
+        put(header.kind_offset, columns.kind.data(), columns.kind.size_bytes());
+        put(header.parent_offset, columns.parent.data(), columns.parent.size_bytes());
+        put(header.first_child_offset, columns.first_child.data(), columns.first_child.size_bytes());
+        put(header.child_count_offset, columns.child_count.data(), columns.child_count.size_bytes());
+        put(header.name_offset_offset, columns.name_offset.data(), columns.name_offset.size_bytes());
+        put(header.names_offset, columns.names.data(), columns.names.size());
+        put(header.size_offset, columns.size.data(), columns.size.size_bytes());
+        put(header.mtime_offset, columns.mtime.data(), columns.mtime.size_bytes());
+        put(header.mode_offset, columns.mode.data(), columns.mode.size_bytes());
+
+        const std::string temporary = filename + ".tmp";
+        std::FILE* out = std::fopen(temporary.c_str(), "wb");
+        if (!out)
+            throw BadTreeFile("cannot create " + temporary);
+        const bool written = std::fwrite(image.data(), 1, image.size(), out) == image.size();
+        if (std::fclose(out) != 0 || !written || std::rename(temporary.c_str(), filename.c_str()) != 0)
+        {
+            std::remove(temporary.c_str());
+            throw BadTreeFile("cannot write " + filename);
+        }
+    }
+
+    // Maps the file read-only; the returned tree serves every query straight from the mapping.
+    // The header, the section bounds and then every node link and name range are checked once
+    // here, O(n), so that a truncated or corrupt file is rejected instead of read out of bounds.
+    static FlatTree Map(const std::string& filename)
+    {
+        const int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw BadTreeFile("cannot open " + filename);
+        struct stat st{};
+        if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(TreeFileHeader))
+        {
+            ::close(fd);
+            throw BadTreeFile("truncated " + filename);
+        }
+        void* data = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            throw BadTreeFile("cannot map " + filename);
+        auto mapping = std::make_shared<Mapping>(data, static_cast<std::size_t>(st.st_size));
+
+        TreeFileHeader header;
+        std::memcpy(&header, mapping->Data(), sizeof header);
+        if (std::memcmp(header.magic, TreeFileHeader::kMagic, sizeof header.magic) != 0)
+            throw BadTreeFile("not a tree file: " + filename);
+        if (header.version != TreeFileHeader::kVersion)
+            throw BadTreeFile("unsupported version " + std::to_string(header.version));
+        const TreeFileHeader expected = Layout(header.node_count, header.name_bytes);
+        if (header.node_count == 0 || std::memcmp(&header, &expected, sizeof header) != 0
+            || header.file_size > static_cast<std::uint64_t>(st.st_size))
+            throw BadTreeFile("corrupt section table in " + filename);
+
+        const char* base = mapping->Data();
+        const FlatTree::Columns columns{
+            Section<NodeKind>(base, header.kind_offset, header.node_count),
+            Section<FlatTree::Index>(base, header.parent_offset, header.node_count),
+            Section<FlatTree::Index>(base, header.first_child_offset, header.node_count),
+            Section<FlatTree::Index>(base, header.child_count_offset, header.node_count),
+            Section<std::uint32_t>(base, header.name_offset_offset, header.node_count + std::size_t{1}),
+            std::string_view(base + header.names_offset, header.name_bytes),
+            Section<std::uint64_t>(base, header.size_offset, header.node_count),
+            Section<std::int64_t>(base, header.mtime_offset, header.node_count),
+            Section<std::uint32_t>(base, header.mode_offset, header.node_count)};
+        if (!LinksAreSound(columns))
+            throw BadTreeFile("corrupt node links in " + filename);
+        return FlatTree(columns, std::move(mapping));
+    }
+};
+
+// A tree loaded from a TreeFile. Reads go to the mapping until the first write, which
+// materializes the whole tree as a FileItem; from then on reads and writes use that.
+class LoadedTree
+{
+    FlatTree                    m_view;
+    std::optional<FileItem>     m_tree;
+public:
+    explicit LoadedTree(FlatTree view) : m_view(std::move(view)) {}
+    static LoadedTree Open(const std::string& filename) { return LoadedTree(TreeFile::Map(filename)); }
+
+    bool IsMaterialized() const { return m_tree.has_value(); }
+    const FlatTree& View() const { return m_view; }
+
+    std::string_view GetName(const Path& path) const
+    {
+        if (m_tree)
+            return (*m_tree)[path].GetName();
+        return m_view[path].GetName();
+    }
+    int ChildCount(const Path& path) const
+    {
+        if (m_tree)
+        {
+            return std::visit([](const auto& item) {
+                if constexpr (std::is_base_of_v<ContainerFileItem, std::remove_cvref_t<decltype(item)>>)
+                    return item.Size();
+                else
+                    return 0;
+            }, static_cast<const FileItemVariant&>((*m_tree)[path]));
+        }
+        return static_cast<int>(m_view.ChildCount(m_view[path].GetIndex()));
+    }
+    FileItem& Mutable()
+    {
+        if (!m_tree)
+            m_tree = m_view.Materialize();
+        return *m_tree;
+    }
+    void Rename(const Path& path, std::string_view new_name) { Mutable()[path].Rename(new_name); }
+};
@@ -0,0 +1,154 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include "FileItem.h"
+
+// Synthetic trees for benchmarks. Each generator returns the tree, the number of nodes in it,
+// and a probe: a path to one of the deepest, last-visited nodes.
+enum class TreeShape { Wide, Deep, Balanced, Realistic };
+
+struct GeneratedTree
+{
+    FileItem    tree;
+    std::size_t nodes;
+    Path        probe;
+};
+
+inline const char* ShapeName(TreeShape shape)
+{
+    switch (shape)
+    {
+    case TreeShape::Wide:       return "wide";
+    case TreeShape::Deep:       return "deep";
+    case TreeShape::Balanced:   return "balanced";
+    case TreeShape::Realistic:  return "realistic";
+    }
+    return "";
+}
+
+class TreeGenerator
+{
+    FileItem::allocator_type    m_alloc;
+    char                        m_buffer[64];
+
+    std::string_view Name(const char* format, std::size_t n)
+    {
+        const int length = std::snprintf(m_buffer, sizeof m_buffer, format, n);
+        return std::string_view{m_buffer, static_cast<std::size_t>(length)};
+    }
+    std::pmr::vector<FileItem> Contents(std::size_t reserve)
+    {
+        std::pmr::vector<FileItem> contents(m_alloc);
+        contents.reserve(reserve);
+        return contents;
+    }
+    FileItem Balanced(int fan_out, int depth, std::size_t& nodes)
+    {
+        ++nodes;
+        if (depth == 0)
+            return File{Name("balanced_file_%zu.txt", nodes), m_alloc};
+        auto contents = Contents(fan_out);
+        for (int i = 0; i < fan_out; ++i)
+            contents.emplace_back(Balanced(fan_out, depth - 1, nodes));
+        return Directory{Name("balanced_directory_%zu", nodes), std::move(contents)};
+    }
+public:
+    explicit TreeGenerator(FileItem::allocator_type alloc = {}) : m_alloc(alloc) {}
+
+    // one directory holding every file
+    GeneratedTree Wide(std::size_t files)
+    {
+        auto contents = Contents(files);
+        for (std::size_t f = 0; f < files; ++f)
+            contents.emplace_back(File{Name("file_number_%zu.txt", f), m_alloc});
+        auto drive = Contents(1);
+        drive.emplace_back(Directory{"wide", std::move(contents)});
+        return {Drive{'c', std::move(drive)}, files + 2, Path{0, static_cast<int>(files) - 1}};
+    }
+    // a chain of directories with one file at the bottom
+    GeneratedTree Deep(std::size_t depth)
+    {
+        FileItem chain = File{"bottom.txt", m_alloc};
+        for (std::size_t d = 0; d < depth; ++d)
+        {
+            auto contents = Contents(1);
+            contents.emplace_back(std::move(chain));
+            chain = Directory{Name("level_%zu", depth - d), std::move(contents)};
+        }
+        auto drive = Contents(1);
+        drive.emplace_back(std::move(chain));
+        return {Drive{'c', std::move(drive)}, depth + 2, Path(depth + 1, 0)};
+    }
+    // fan_out^depth files below a drive
+    GeneratedTree Balanced(int fan_out, int depth)
+    {
+        std::size_t nodes = 1;
+        auto drive = Contents(1);
+        drive.emplace_back(Balanced(fan_out, depth, nodes));
+        Path probe(depth + 1, fan_out - 1);
+        probe[0] = 0;
+        return {Drive{'c', std::move(drive)}, nodes, std::move(probe)};
+    }
+    // Directories of log-normally distributed size, several levels deep, with names that
+    // repeat the way repository content does.
+    GeneratedTree Realistic(std::size_t files, unsigned seed = 42)
+    {
+        static const std::string_view common[] = {"index.html", ".git", "README", "README.md", "CMakeLists.txt",
+            "package.json", "LICENSE", "Makefile", ".gitignore", "main.cpp", "__init__.py", "config.yaml"};
+        std::mt19937 rng(seed);
+        std::lognormal_distribution<double> dir_size(2.5, 1.0);
+        std::uniform_int_distribution<int> pick(0, 99);
+        // file attributes draw from their own generator so the shape matches older corpora
+        std::mt19937 attribute_rng(seed);
+        std::lognormal_distribution<double> file_size(8.0, 2.5);
+        std::uniform_int_distribution<std::int64_t> mtime(1'500'000'000'000'000'000, 1'700'000'000'000'000'000);
+        const auto attributes = [&] {
+            return FileAttributes{static_cast<std::uint64_t>(file_size(attribute_rng)), mtime(attribute_rng), 0100644};
+        };
+
+        std::size_t nodes = 1, made = 0, dir_number = 0;
+        auto projects = Contents(0);
+        Path probe;
+        while (made < files)
+        {
+            auto versions = Contents(4);
+            for (int v = 0; v < 4 && made < files; ++v)
+            {
+                auto entries = Contents(0);
+                const auto count = std::min<std::size_t>(files - made, 1 + static_cast<std::size_t>(dir_size(rng)));
+                for (std::size_t f = 0; f < count; ++f, ++made)
+                {
+                    const int p = pick(rng);
+                    if (p < 60)
+                        entries.emplace_back(File{common[p % std::size(common)], attributes(), m_alloc});
+                    else
+                        entries.emplace_back(File{Name("source_file_%zu.cpp", made), attributes(), m_alloc});
+                }
+                nodes += count + 1;
+                probe = Path{static_cast<int>(projects.size()), v, static_cast<int>(count) - 1};
+                versions.emplace_back(Directory{Name("v1.%zu.0", static_cast<std::size_t>(v)), std::move(entries)});
+            }
+            nodes += 1;
+            projects.emplace_back(Directory{Name("project_%zu", dir_number++), std::move(versions)});
+        }
+        return {Drive{'c', std::move(projects)}, nodes, probe};
+    }
+    GeneratedTree Make(TreeShape shape, std::size_t nodes)
+    {
+        switch (shape)
+        {
+        case TreeShape::Wide:       return Wide(nodes);
+        case TreeShape::Deep:       return Deep(nodes);
+        case TreeShape::Balanced:
+        {
+            int depth = 1;
+            for (std::size_t n = 8; n * 8 <= nodes; n *= 8)
+                ++depth;
+            return Balanced(8, depth);
+        }
+        case TreeShape::Realistic:  return Realistic(nodes);
+        }
+        return Wide(nodes);
+    }
+};
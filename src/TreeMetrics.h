@@ -0,0 +1,170 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Build with -DFILEEXAMPLE_METRICS=1 (cmake -DFILEEXAMPLE_METRICS=ON) to count what the tree
+// operations do. When it is 0 every FILEEXAMPLE_METRIC() compiles to nothing and Collect()
+// reports zeros.
+#ifndef FILEEXAMPLE_METRICS
+#define FILEEXAMPLE_METRICS 0
+#endif
+
+#if FILEEXAMPLE_METRICS
+#define FILEEXAMPLE_METRIC(counter, amount) TreeMetrics::Add(TreeMetrics::counter, (amount))
+#else
+#define FILEEXAMPLE_METRIC(counter, amount) ((void)0)
+#endif
+
+// Process-wide operation counters. Each thread counts into its own block with plain relaxed
+// stores, so counting costs no shared cache line; Collect() sums the live blocks and those of
+// threads that have exited.
+class TreeMetrics
+{
+public:
+    static constexpr bool kEnabled = FILEEXAMPLE_METRICS;
+
+    enum Counter : std::size_t
+    {
+        RecurseCalls,
+        RecurseNodes,
+        RecurseNanoseconds,
+        PathLookups,
+        PathDepth,
+        NonExistMisses,
+        RenameCalls,
+        BytesAllocated,
+        kCounters
+    };
+
+    struct Snapshot
+    {
+        std::array<std::uint64_t, kCounters> values{};
+
+        std::uint64_t operator[](Counter counter) const { return values[counter]; }
+        // Counts accumulated since earlier was collected.
+        Snapshot Since(const Snapshot& earlier) const
+        {
+            Snapshot delta;
+            for (std::size_t i = 0; i < kCounters; ++i)
+                delta.values[i] = values[i] - earlier.values[i];
+            return delta;
+        }
+        // Prometheus text exposition format, one counter per metric.
+        std::string ToPrometheus() const
+        {
+            std::string out;
+            for (std::size_t i = 0; i < kCounters; ++i)
+            {
+                const Description& description = kDescriptions[i];
+                out.append("# HELP fileexample_").append(description.name).append(" ").append(description.help).append("\n");
+                out.append("# TYPE fileexample_").append(description.name).append(" counter\n");
+                out.append("fileexample_").append(description.name).append(" ").append(std::to_string(values[i])).append("\n");
+            }
+            return out;
+        }
+    };
+
+    static void Add(Counter counter, std::uint64_t amount)
+    {
+        auto& value = Local().values[counter];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+    static Snapshot Collect()
+    {
+        Snapshot snapshot;
+        if constexpr (kEnabled)
+        {
+            Registry& registry = GetRegistry();
+            std::lock_guard lock(registry.mutex);
+            snapshot = registry.exited;
+            for (const Block* block : registry.live)
+                for (std::size_t i = 0; i < kCounters; ++i)
+                    snapshot.values[i] += block->values[i].load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+
+    // Adds the time until destruction to a nanoseconds counter.
+    class Timer
+    {
+#if FILEEXAMPLE_METRICS
+        Counter                                 m_counter;
+        std::chrono::steady_clock::time_point   m_start{std::chrono::steady_clock::now()};
+    public:
+        explicit Timer(Counter counter) : m_counter(counter) {}
+        ~Timer()
+        {
+            const auto elapsed = std::chrono::steady_clock::now() - m_start;
+            Add(m_counter, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+#else
+    public:
+        explicit Timer(Counter) {}
+#endif
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    };
+
+private:
+    struct Description
+    {
+        const char* name;
+        const char* help;
+    };
+    static constexpr Description kDescriptions[kCounters] = {
+        {"recurse_calls_total", "Top-level FileItem::Recurse calls."},
+        {"recurse_nodes_total", "Nodes visited by FileItem::Recurse."},
+        {"recurse_nanoseconds_total", "Time spent in top-level FileItem::Recurse calls."},
+        {"path_lookups_total", "Lookups by Path through TryGet and operator[]."},
+        {"path_depth_total", "Levels walked by lookups by Path."},
+        {"nonexist_misses_total", "Lookups that found no node."},
+        {"rename_calls_total", "FileItem::TryRename and Rename calls."},
+        {"allocated_bytes_total", "Bytes allocated for child blocks, child vectors and names."},
+    };
+
+    struct Block
+    {
+        std::array<std::atomic<std::uint64_t>, kCounters> values{};
+    };
+    struct Registry
+    {
+        std::mutex          mutex;
+        std::vector<Block*> live;
+        Snapshot            exited;
+    };
+    static Registry& GetRegistry()
+    {
+        static Registry registry;
+        return registry;
+    }
+    // Registers the thread's block on first use and folds it into the exited totals when the
+    // thread ends.
+    struct ThreadBlock
+    {
+        Block block;
+        ThreadBlock()
+        {
+            Registry& registry = GetRegistry();
+            std::lock_guard lock(registry.mutex);
+            registry.live.push_back(&block);
+        }
+        ~ThreadBlock()
+        {
+            Registry& registry = GetRegistry();
+            std::lock_guard lock(registry.mutex);
+            for (std::size_t i = 0; i < kCounters; ++i)
+                registry.exited.values[i] += block.values[i].load(std::memory_order_relaxed);
+            std::erase(registry.live, &block);
+        }
+    };
+    static Block& Local()
+    {
+        thread_local ThreadBlock local;
+        return local.block;
+    }
+};
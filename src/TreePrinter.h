@@ -0,0 +1,147 @@
+#pragma once
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+#include <unistd.h>
+#include "FileItem.h"
+
+// Sinks receive large blocks from TreePrinter.
+class FdSink
+{
+    int m_fd;
+public:
+    explicit FdSink(int fd) : m_fd(fd) {}
+    void Write(std::string_view block)
+    {
+        while (!block.empty())
+        {
+            const ssize_t written = ::write(m_fd, block.data(), block.size());
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "write");
+            }
+            block.remove_prefix(static_cast<std::size_t>(written));
+        }
+    }
+};
+
+class FileSink
+{
+    std::FILE* m_file;
+public:
+    explicit FileSink(std::FILE* file) : m_file(file) {}
+    void Write(std::string_view block)
+    {
+        if (std::fwrite(block.data(), 1, block.size(), m_file) != block.size())
+            throw std::system_error(errno, std::generic_category(), "fwrite");
+    }
+};
+
+class StringSink
+{
+    std::string* m_out;
+public:
+    explicit StringSink(std::string& out) : m_out(&out) {}
+    void Write(std::string_view block) { m_out->append(block); }
+};
+
+class OStreamSink
+{
+    std::ostream* m_os;
+public:
+    explicit OStreamSink(std::ostream& os) : m_os(&os) {}
+    void Write(std::string_view block) { m_os->write(block.data(), static_cast<std::streamsize>(block.size())); }
+};
+
+// Writes one line per node, indented by one tab per level, into a reusable buffer that is
+// handed to the sink only when full (and on Flush / destruction). Sink errors surface as
+// exceptions from Print, Line and Flush; the destructor cannot report them and drops them,
+// so call Flush() before the printer goes away to find out whether the output was written.
+template<class Sink>
+class TreePrinter
+{
+    static constexpr std::size_t kTabRun = 256;
+    static inline const std::string s_tabs = std::string(kTabRun, '\t');
+
+    Sink                m_sink;
+    std::vector<char>   m_buffer;
+    std::size_t         m_used{0};
+
+    void Append(std::string_view text)
+    {
+        if (text.size() > m_buffer.size() - m_used)
+        {
+            Flush();
+            if (text.size() > m_buffer.size())
+            {
+                m_sink.Write(text);
+                return;
+            }
+        }
+        std::memcpy(m_buffer.data() + m_used, text.data(), text.size());
+        m_used += text.size();
+    }
+    void Indent(std::size_t depth)
+    {
+        for (; depth > kTabRun; depth -= kTabRun)
+            Append(s_tabs);
+        Append(std::string_view{s_tabs}.substr(0, depth));
+    }
+public:
+    explicit TreePrinter(Sink sink, std::size_t buffer_size = 1 << 16)
+        : m_sink(std::move(sink)), m_buffer(buffer_size ? buffer_size : 1) {}
+    TreePrinter(const TreePrinter&) = delete;
+    TreePrinter& operator=(const TreePrinter&) = delete;
+    ~TreePrinter()
+    {
+        try
+        {
+            Flush();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    void Print(const FileItem& item)
+    {
+        item.Traverse([this](const auto& fi, std::span<const int> path) {
+            Line(path.size(), fi.GetName());
+        });
+    }
+    // one node: depth tabs, the name, a newline
+    void Line(std::size_t depth, std::string_view name)
+    {
+        const std::size_t length = depth + name.size() + 1;
+        if (depth > kTabRun || length > m_buffer.size() - m_used)
+        {
+            // slow path: long lines are split across flushes
+            Indent(depth);
+            Append(name);
+            Append("\n");
+            return;
+        }
+        char* out = m_buffer.data() + m_used;
+        std::memcpy(out, s_tabs.data(), depth);
+        std::memcpy(out + depth, name.data(), name.size());
+        out[length - 1] = '\n';
+        m_used += length;
+    }
+    void Flush()
+    {
+        if (m_used)
+            m_sink.Write(std::string_view{m_buffer.data(), m_used});
+        m_used = 0;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const FileItem& item)
+{
+    TreePrinter<OStreamSink> printer{OStreamSink{os}};
+    printer.Print(item);
+    printer.Flush();
+    return os;
+}
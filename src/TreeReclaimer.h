@@ -0,0 +1,81 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "FileItem.h"
+#include "ParallelRecurse.h"
+
+// Destroys trees on a background thread, so that dropping a large tree, at shutdown or after
+// swapping in a new snapshot, costs the caller a move. Each tree is torn down with
+// ParallelDestroy, which spreads the work over TBB's threads. A tree's resource must outlive
+// its reclamation: Drain() before destroying an allocator that retired trees still use.
+class TreeReclaimer
+{
+public:
+    explicit TreeReclaimer(ParallelOptions options = {}) : m_options(options), m_thread([this] { Run(); }) {}
+    TreeReclaimer(const TreeReclaimer&) = delete;
+    TreeReclaimer& operator=(const TreeReclaimer&) = delete;
+    // Destroys whatever is still queued, then stops.
+    ~TreeReclaimer()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_work.notify_one();
+        m_thread.join();
+    }
+
+    void Retire(FileItem&& tree)
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_queue.push_back(std::move(tree));
+        }
+        m_work.notify_one();
+    }
+    // Waits until every tree retired so far has been destroyed.
+    void Drain()
+    {
+        std::unique_lock lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+    }
+    // Trees retired and not yet destroyed.
+    std::size_t Pending() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_queue.size() + (m_busy ? 1 : 0);
+    }
+
+private:
+    void Run()
+    {
+        std::unique_lock lock(m_mutex);
+        for (;;)
+        {
+            m_work.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty())
+                return;
+            FileItem tree = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_busy = true;
+            lock.unlock();
+            ParallelDestroy(std::move(tree), m_options);
+            lock.lock();
+            m_busy = false;
+            if (m_queue.empty())
+                m_idle.notify_all();
+        }
+    }
+
+    ParallelOptions             m_options;
+    mutable std::mutex          m_mutex;
+    std::condition_variable     m_work;
+    std::condition_variable     m_idle;
+    std::deque<FileItem>        m_queue;
+    bool                        m_busy{false};
+    bool                        m_stopping{false};
+    // last, so that everything above exists before the thread starts
+    std::thread                 m_thread;
+};
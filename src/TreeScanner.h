@@ -0,0 +1,201 @@
+#pragma once
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <semaphore>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+#include "FileItem.h"
+
+struct ScanOptions
+{
+    // upper bound on directory handles open at once
+    int max_open_directories{64};
+    // 0 uses every core
+    int max_threads{0};
+    // stat() every file to record its size, mtime and mode; costs one syscall per file
+    bool file_attributes{false};
+};
+
+// Populates a Drive from a directory on disk. Each directory is read in one pass
+// (readdir, i.e. getdents64, using d_type where the filesystem provides it) and its entries
+// are published into the tree as a batch; subdirectories are then scanned in parallel on
+// TBB. The tree can be read through Read() at any point during the scan. Symbolic links are
+// recorded as files and never followed.
+class TreeScanner
+{
+public:
+    struct Stats
+    {
+        std::uint64_t entries;
+        std::uint64_t directories;
+        std::uint64_t errors;
+    };
+
+    TreeScanner(std::string root, char drive_letter = 'a', ScanOptions options = {})
+        : m_root_path(std::move(root))
+        , m_options(options)
+        , m_tree(Drive{drive_letter})
+        , m_handles(options.max_open_directories < 1 ? 1 : options.max_open_directories)
+        {}
+    TreeScanner(const TreeScanner&) = delete;
+    TreeScanner& operator=(const TreeScanner&) = delete;
+    ~TreeScanner()
+    {
+        Cancel();
+        Wait();
+    }
+
+    // Starts scanning in the background; returns immediately.
+    void Start()
+    {
+        m_worker = std::thread([this] {
+            const auto run = [this] {
+                tbb::task_group tasks;
+                tasks.run([this, &tasks] { ScanDirectory(Path{}, m_root_path, tasks); });
+                tasks.wait();
+            };
+            if (m_options.max_threads > 0)
+                tbb::task_arena(m_options.max_threads).execute(run);
+            else
+                run();
+            m_done.store(true, std::memory_order_release);
+        });
+    }
+    void Wait()
+    {
+        if (m_worker.joinable())
+            m_worker.join();
+    }
+    // Directories not yet opened are skipped; the tree keeps what was already read.
+    void Cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+    bool Done() const { return m_done.load(std::memory_order_acquire); }
+
+    // Calls fn(const FileItem& root) while holding the tree's lock, and returns its result. The
+    // lock is exclusive, also against other readers: const Find() and Aggregates() fill caches
+    // in the nodes they pass, so two readers would race on them.
+    // A plain copy taken in fn is a snapshot: the scan reaches every node it fills from the
+    // root, and so gets its own copy of whatever the snapshot shares. Aggregates() and Digest()
+    // describe the tree as read so far.
+    template<class Fn>
+    decltype(auto) Read(Fn&& fn) const
+    {
+        std::lock_guard lock(m_mutex);
+        return std::forward<Fn>(fn)(std::as_const(m_tree));
+    }
+    // Only valid once the scan is done.
+    FileItem& Tree() { return m_tree; }
+    Stats GetStats() const
+    {
+        return Stats{m_entries.load(std::memory_order_relaxed), m_directories.load(std::memory_order_relaxed),
+            m_errors.load(std::memory_order_relaxed)};
+    }
+private:
+    struct Entry
+    {
+        std::string     name;
+        bool            is_directory;
+        FileAttributes  attributes;
+    };
+
+    bool ReadEntries(const std::string& path, std::vector<Entry>& entries)
+    {
+        m_handles.acquire();
+        const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        DIR* dir = fd < 0 ? nullptr : ::fdopendir(fd);
+        if (!dir)
+        {
+            if (fd >= 0)
+                ::close(fd);
+            m_handles.release();
+            return false;
+        }
+        while (const dirent* entry = ::readdir(dir))
+        {
+            const std::string_view name{entry->d_name};
+            if (name == "." || name == "..")
+                continue;
+            bool is_directory = entry->d_type == DT_DIR;
+            FileAttributes attributes;
+            if (entry->d_type == DT_UNKNOWN || (m_options.file_attributes && !is_directory))
+            {
+                struct stat st{};
+                const bool found = ::fstatat(::dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+                is_directory = found && S_ISDIR(st.st_mode);
+                if (found && m_options.file_attributes)
+                    attributes = FileAttributes{static_cast<std::uint64_t>(st.st_size),
+                        static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec,
+                        static_cast<std::uint32_t>(st.st_mode)};
+            }
+            entries.push_back(Entry{std::string{name}, is_directory, attributes});
+        }
+        ::closedir(dir);
+        m_handles.release();
+        return true;
+    }
+
+    // Tasks name their node by position and reach it from the root under the lock: that walk
+    // dirties the cached aggregates and digest of every ancestor, and gives the tree its own
+    // copy of a container a reader has shared, which would leave a saved pointer behind.
+    void ScanDirectory(const Path& node_path, std::string path, tbb::task_group& tasks)
+    {
+        if (m_cancelled.load(std::memory_order_relaxed))
+            return;
+        std::vector<Entry> entries;
+        if (!ReadEntries(path, entries))
+        {
+            m_errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::pmr::vector<FileItem> contents;
+        contents.reserve(entries.size());
+        for (const Entry& entry : entries)
+        {
+            if (entry.is_directory)
+                contents.emplace_back(Directory{entry.name});
+            else
+                contents.emplace_back(File{entry.name, entry.attributes});
+        }
+        {
+            std::lock_guard lock(m_mutex);
+            std::visit([&contents](auto& item) {
+                using FileItemType = std::remove_cvref_t<decltype(item)>;
+                if constexpr (std::is_same_v<FileItemType, Drive>)
+                    item = Drive{item.GetName()[0], std::move(contents)};
+                else if constexpr (std::is_same_v<FileItemType, Directory>)
+                    item = Directory{item.GetName(), std::move(contents)};
+            }, static_cast<FileItemVariant&>(m_tree[node_path]));
+        }
+        m_entries.fetch_add(entries.size(), std::memory_order_relaxed);
+        m_directories.fetch_add(1, std::memory_order_relaxed);
+
+        // children are where their entries were read
+        for (std::size_t i = 0; i < entries.size(); ++i)
+        {
+            if (!entries[i].is_directory)
+                continue;
+            Path child = node_path;
+            child.push_back(static_cast<int>(i));
+            std::string child_path = path + "/" + entries[i].name;
+            tasks.run([this, child = std::move(child), child_path = std::move(child_path), &tasks] {
+                ScanDirectory(child, child_path, tasks);
+            });
+        }
+    }
+
+    std::string                 m_root_path;
+    ScanOptions                 m_options;
+    FileItem                    m_tree;
+    mutable std::mutex          m_mutex;
+    std::counting_semaphore<>   m_handles;
+    std::thread                 m_worker;
+    std::atomic<bool>           m_cancelled{false};
+    std::atomic<bool>           m_done{false};
+    std::atomic<std::uint64_t>  m_entries{0};
+    std::atomic<std::uint64_t>  m_directories{0};
+    std::atomic<std::uint64_t>  m_errors{0};
+};
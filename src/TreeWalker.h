@@ -0,0 +1,140 @@
+#pragma once
+#include "FileItem.h"
+
+// Non-recursive walker; the depth of the tree is bounded by the heap, not the call stack.
+enum class WalkOrder { PreOrder, PostOrder };
+enum class WalkAction { Continue, Prune, Stop };
+
+using ConstNodeRef = std::variant<const Drive*, const File*, const Directory*>;
+
+inline ConstNodeRef MakeNodeRef(const FileItem& fi)
+{
+    return std::visit([](const auto& item)->ConstNodeRef { return &item; },
+        static_cast<const FileItemVariant&>(fi));
+}
+
+class TreeWalker
+{
+    struct Frame
+    {
+        ConstNodeRef                node;
+        const ContainerFileItem*    container;
+        int                         next_child;
+        int                         index;
+    };
+    std::stack<Frame, std::vector<Frame>>   m_stack;
+    Path                                    m_path;
+    ConstNodeRef                            m_root;
+    WalkOrder                               m_order;
+    bool                                    m_started{false};
+    bool                                    m_pruned{false};
+
+    void Push(ConstNodeRef node, int index)
+    {
+        const ContainerFileItem* container = std::visit([](auto* item)->const ContainerFileItem* {
+            if constexpr (std::is_base_of_v<ContainerFileItem, std::remove_pointer_t<decltype(item)>>)
+                return item;
+            else
+                return nullptr;
+        }, node);
+        m_stack.push(Frame{node, container, 0, index});
+        if (index >= 0)
+            m_path.push_back(index);
+    }
+    void Pop()
+    {
+        if (m_stack.top().index >= 0)
+            m_path.pop_back();
+        m_stack.pop();
+    }
+    // push the next unvisited child of the top frame, if any
+    bool Descend()
+    {
+        Frame& top = m_stack.top();
+        if (!top.container || top.next_child >= top.container->Size())
+            return false;
+        const int idx = top.next_child++;
+        Push(MakeNodeRef(top.container->Get(idx)), idx);
+        return true;
+    }
+    bool NextPreOrder()
+    {
+        if (m_pruned)
+        {
+            m_stack.top().next_child = m_stack.top().container ? m_stack.top().container->Size() : 0;
+            m_pruned = false;
+        }
+        while (!m_stack.empty())
+        {
+            if (Descend())
+                return true;
+            Pop();
+        }
+        return false;
+    }
+    bool NextPostOrder()
+    {
+        Pop();
+        if (m_stack.empty())
+            return false;
+        while (Descend()) {}
+        return true;
+    }
+public:
+    TreeWalker(const FileItem& root, WalkOrder order = WalkOrder::PreOrder) : m_root(MakeNodeRef(root)), m_order(order) {}
+    TreeWalker(const Drive& root, WalkOrder order = WalkOrder::PreOrder) : m_root(&root), m_order(order) {}
+    TreeWalker(const Directory& root, WalkOrder order = WalkOrder::PreOrder) : m_root(&root), m_order(order) {}
+    TreeWalker(const File& root, WalkOrder order = WalkOrder::PreOrder) : m_root(&root), m_order(order) {}
+
+    // Advances to the next node; returns false once the walk is complete.
+    bool Next()
+    {
+        if (!m_started)
+        {
+            m_started = true;
+            Push(m_root, -1);
+            if (m_order == WalkOrder::PostOrder)
+                while (Descend()) {}
+            return true;
+        }
+        if (m_stack.empty())
+            return false;
+        return m_order == WalkOrder::PreOrder ? NextPreOrder() : NextPostOrder();
+    }
+    ConstNodeRef Current() const { return m_stack.top().node; }
+    std::span<const int> CurrentPath() const { return std::span<const int>(m_path.data(), m_path.size()); }
+    int Depth() const { return (int)m_path.size(); }
+    // Skip the children of the current node. Only meaningful in pre-order;
+    // in post-order the children have already been visited.
+    void Prune() { if (m_order == WalkOrder::PreOrder) m_pruned = true; }
+
+    // Calls fn(item, path) for every remaining node. fn may return void or a WalkAction.
+    // Returns false if the walk was stopped by the visitor.
+    template<class Fn>
+    bool Walk(Fn&& fn)
+    {
+        while (Next())
+        {
+            const WalkAction action = std::visit([this, &fn](auto* item) {
+                if constexpr (std::is_void_v<decltype(fn(*item, CurrentPath()))>)
+                {
+                    fn(*item, CurrentPath());
+                    return WalkAction::Continue;
+                }
+                else
+                    return static_cast<WalkAction>(fn(*item, CurrentPath()));
+            }, Current());
+            if (action == WalkAction::Stop)
+                return false;
+            if (action == WalkAction::Prune)
+                Prune();
+        }
+        return true;
+    }
+};
+
+template<class Root, class Fn>
+bool Walk(const Root& root, Fn&& fn, WalkOrder order = WalkOrder::PreOrder)
+{
+    return TreeWalker(root, order).Walk(std::forward<Fn>(fn));
+}
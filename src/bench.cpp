@@ -0,0 +1,1394 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <sys/resource.h>
+#include "FileItem.h"
+#include "TreeArena.h"
+#include "FlatTree.h"
+#include "ParallelRecurse.h"
+#include "TreePrinter.h"
+#include "TreeGenerators.h"
+#include "TreeFile.h"
+#include "TreeScanner.h"
+#include "ConcurrentTree.h"
+#include "TreeBatch.h"
+#include "NameSearch.h"
+#include "SortedDirectory.h"
+#include "NodeTable.h"
+#include "TreeDiff.h"
+#include "TreeCoroutines.h"
+#include "TreeReclaimer.h"
+
+namespace
+{
+std::atomic<std::size_t> g_allocations{0};
+std::atomic<std::size_t> g_allocated_bytes{0};
+}
+
+void* operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc{};
+}
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    const auto alignment = static_cast<std::size_t>(align);
+    if (void* p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)) return p;
+    throw std::bad_alloc{};
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace
+{
+void ReportPerNode(benchmark::State& state, std::size_t nodes, std::size_t allocations)
+{
+    state.counters["nodes"] = static_cast<double>(nodes);
+    state.counters["allocs/node"] = static_cast<double>(allocations) / static_cast<double>(nodes * state.iterations());
+    state.SetItemsProcessed(static_cast<int64_t>(nodes * state.iterations()));
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// process-wide high-water mark; run one benchmark per process to compare layouts
+void ReportPeakRss(benchmark::State& state)
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    state.counters["peak_rss_MB"] = static_cast<double>(usage.ru_maxrss) / 1024.0;
+}
+}
+
+// Core operation suite, registered for every TreeShape as Core/<operation>/<shape>.
+// The tree for a shape is built once and reused by every benchmark on that shape.
+namespace
+{
+std::size_t CoreSize(TreeShape shape)
+{
+    switch (shape)
+    {
+    case TreeShape::Deep:       return 1 << 13;
+    case TreeShape::Balanced:   return 1 << 18;
+    default:                    return 1 << 20;
+    }
+}
+
+GeneratedTree& CoreTree(TreeShape shape)
+{
+    static std::optional<TreeShape> built;
+    static std::optional<GeneratedTree> tree;
+    if (built != shape)
+    {
+        tree.reset();
+        tree = TreeGenerator{}.Make(shape, CoreSize(shape));
+        built = shape;
+    }
+    return *tree;
+}
+
+// discards everything written to it
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+void CoreRecurse(benchmark::State& state, TreeShape shape)
+{
+    const GeneratedTree& corpus = CoreTree(shape);
+    const std::size_t before = g_allocations.load();
+    for (auto _ : state)
+    {
+        std::size_t nodes = 0;
+        corpus.tree.Recurse([&nodes](const auto&, const Path& path) { benchmark::DoNotOptimize(path.data()); ++nodes; });
+        benchmark::DoNotOptimize(nodes);
+    }
+    ReportPerNode(state, corpus.nodes, g_allocations.load() - before);
+}
+
+void CoreTraverse(benchmark::State& state, TreeShape shape)
+{
+    const GeneratedTree& corpus = CoreTree(shape);
+    const std::size_t before = g_allocations.load();
+    for (auto _ : state)
+    {
+        std::size_t nodes = 0;
+        corpus.tree.Traverse([&nodes](const auto&, std::span<const int> path) { benchmark::DoNotOptimize(path.data()); ++nodes; });
+        benchmark::DoNotOptimize(nodes);
+    }
+    ReportPerNode(state, corpus.nodes, g_allocations.load() - before);
+}
+
+void CorePathLookup(benchmark::State& state, TreeShape shape)
+{
+    GeneratedTree& corpus = CoreTree(shape);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(&corpus.tree[corpus.probe]);
+    state.counters["depth"] = static_cast<double>(corpus.probe.size());
+}
+
+void CoreRename(benchmark::State& state, TreeShape shape)
+{
+    GeneratedTree& corpus = CoreTree(shape);
+    FileItem& target = corpus.tree[corpus.probe];
+    const std::string original{target.GetName()};
+    bool flip = false;
+    for (auto _ : state)
+    {
+        corpus.tree[corpus.probe].Rename(flip ? std::string_view{original} : std::string_view{"renamed_by_the_benchmark.txt"});
+        flip = !flip;
+    }
+    target.Rename(original);
+}
+
+void CorePrint(benchmark::State& state, TreeShape shape)
+{
+    const GeneratedTree& corpus = CoreTree(shape);
+    NullBuffer null;
+    std::ostream os(&null);
+    for (auto _ : state)
+        os << corpus.tree;
+    state.SetItemsProcessed(static_cast<int64_t>(corpus.nodes * state.iterations()));
+}
+
+void CoreCopy(benchmark::State& state, TreeShape shape)
+{
+    const GeneratedTree& corpus = CoreTree(shape);
+    const std::size_t before = g_allocations.load();
+    for (auto _ : state)
+    {
+        FileItem copy = corpus.tree;
+        benchmark::DoNotOptimize(&copy);
+        state.PauseTiming();
+        { FileItem discard = std::move(copy); }
+        state.ResumeTiming();
+    }
+    ReportPerNode(state, corpus.nodes, g_allocations.load() - before);
+}
+
+// a deep copy, for comparison with Copy, which only shares the children
+void CoreClone(benchmark::State& state, TreeShape shape)
+{
+    const GeneratedTree& corpus = CoreTree(shape);
+    const std::size_t before = g_allocations.load();
+    for (auto _ : state)
+    {
+        FileItem copy = corpus.tree.Clone();
+        benchmark::DoNotOptimize(&copy);
+        state.PauseTiming();
+        { FileItem discard = std::move(copy); }
+        state.ResumeTiming();
+    }
+    ReportPerNode(state, corpus.nodes, g_allocations.load() - before);
+}
+
+// snapshot, then rename one node in the writable copy: copies the spine to the probe
+void CoreSnapshotRename(benchmark::State& state, TreeShape shape)
+{
+    const GeneratedTree& corpus = CoreTree(shape);
+    for (auto _ : state)
+    {
+        FileItem snapshot = corpus.tree;
+        snapshot[corpus.probe].Rename("renamed_by_the_benchmark.txt");
+        benchmark::DoNotOptimize(&snapshot);
+        state.PauseTiming();
+        { FileItem discard = std::move(snapshot); }
+        state.ResumeTiming();
+    }
+}
+
+void CoreDestroy(benchmark::State& state, TreeShape shape)
+{
+    const GeneratedTree& corpus = CoreTree(shape);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::optional<FileItem> copy = corpus.tree.Clone();
+        state.ResumeTiming();
+        copy.reset();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(corpus.nodes * state.iterations()));
+}
+
+void RegisterCoreSuite()
+{
+    using Operation = void (*)(benchmark::State&, TreeShape);
+    const std::pair<const char*, Operation> operations[] = {
+        {"Recurse", CoreRecurse}, {"Traverse", CoreTraverse}, {"PathLookup", CorePathLookup}, {"Rename", CoreRename},
+        {"Print", CorePrint}, {"Copy", CoreCopy}, {"Clone", CoreClone}, {"SnapshotRename", CoreSnapshotRename},
+        {"Destroy", CoreDestroy}};
+    for (const TreeShape shape : {TreeShape::Wide, TreeShape::Deep, TreeShape::Balanced, TreeShape::Realistic})
+        for (const auto& [name, operation] : operations)
+        {
+            const std::string full_name = std::string("Core/") + name + "/" + ShapeName(shape);
+            benchmark::RegisterBenchmark(full_name.c_str(), operation, shape)->Unit(benchmark::kMicrosecond);
+        }
+}
+}
+
+namespace
+{
+// 1000 directories of files; names are long enough to defeat SSO
+FileItem MakeWideDrive(std::size_t files, FileItem::allocator_type alloc = {})
+{
+    constexpr std::size_t directories = 1000;
+    std::pmr::vector<FileItem> drive_contents(alloc);
+    drive_contents.reserve(directories);
+    for (std::size_t d = 0; d < directories; ++d)
+    {
+        std::pmr::vector<FileItem> dir_contents(alloc);
+        dir_contents.reserve(files / directories);
+        char name[64];
+        for (std::size_t f = 0; f < files / directories; ++f)
+        {
+            const int length = std::snprintf(name, sizeof name, "file_number_%zu.txt", f);
+            dir_contents.emplace_back(File{std::string_view{name, static_cast<std::size_t>(length)}, alloc});
+        }
+        const int length = std::snprintf(name, sizeof name, "directory_number_%zu", d);
+        drive_contents.emplace_back(Directory{std::string_view{name, static_cast<std::size_t>(length)}, std::move(dir_contents)});
+    }
+    return Drive{'c', std::move(drive_contents)};
+}
+}
+
+static void BM_BuildTeardown_Heap(benchmark::State& state)
+{
+    const auto files = static_cast<std::size_t>(state.range(0));
+    const std::size_t before = g_allocations.load();
+    double teardown_ms = 0;
+    for (auto _ : state)
+    {
+        std::optional<FileItem> drive = MakeWideDrive(files);
+        benchmark::DoNotOptimize(&*drive);
+        const auto start = std::chrono::steady_clock::now();
+        drive.reset();
+        teardown_ms += MillisecondsSince(start);
+    }
+    ReportPerNode(state, files, g_allocations.load() - before);
+    state.counters["teardown_ms"] = teardown_ms / static_cast<double>(state.iterations());
+    ReportPeakRss(state);
+}
+BENCHMARK(BM_BuildTeardown_Heap)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BM_BuildTeardown_Arena(benchmark::State& state)
+{
+    const auto files = static_cast<std::size_t>(state.range(0));
+    const std::size_t before = g_allocations.load();
+    double teardown_ms = 0;
+    for (auto _ : state)
+    {
+        std::optional<TreeArena> arena;
+        arena.emplace(1 << 20);
+        std::optional<FileItem> drive = MakeWideDrive(files, arena->Allocator());
+        benchmark::DoNotOptimize(&*drive);
+        const auto start = std::chrono::steady_clock::now();
+        drive.reset();
+        arena.reset();
+        teardown_ms += MillisecondsSince(start);
+    }
+    ReportPerNode(state, files, g_allocations.load() - before);
+    state.counters["teardown_ms"] = teardown_ms / static_cast<double>(state.iterations());
+    ReportPeakRss(state);
+}
+BENCHMARK(BM_BuildTeardown_Arena)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+namespace
+{
+// names drawn from a small vocabulary of typical repository content
+const std::vector<std::string> g_vocabulary = [] {
+    std::vector<std::string> names{"index.html", ".git", "README", "README.md", "CMakeLists.txt", "package.json",
+        "node_modules", "__init__.py", "LICENSE", "Makefile", ".gitignore", "main.cpp"};
+    char name[64];
+    for (int major = 0; major < 8; ++major)
+        for (int minor = 0; minor < 16; ++minor)
+        {
+            std::snprintf(name, sizeof name, "release-candidate-%d.%d.0", major, minor);
+            names.emplace_back(name);
+            std::snprintf(name, sizeof name, "generated_documentation_%d_%d.html", major, minor);
+            names.emplace_back(name);
+        }
+    return names;
+}();
+
+template<class Name>
+FileItem MakeVocabularyDrive(std::size_t files, Name make_name)
+{
+    constexpr std::size_t directories = 1000;
+    std::pmr::vector<FileItem> drive_contents;
+    drive_contents.reserve(directories);
+    std::size_t next = 0;
+    for (std::size_t d = 0; d < directories; ++d)
+    {
+        std::pmr::vector<FileItem> dir_contents;
+        dir_contents.reserve(files / directories);
+        for (std::size_t f = 0; f < files / directories; ++f)
+            dir_contents.emplace_back(File{make_name(g_vocabulary[next++ % g_vocabulary.size()])});
+        Directory dir{"src", std::move(dir_contents)};
+        drive_contents.emplace_back(std::move(dir));
+    }
+    return Drive{'c', std::move(drive_contents)};
+}
+
+template<class Name>
+void BuildVocabularyDrive(benchmark::State& state, Name make_name)
+{
+    const auto files = static_cast<std::size_t>(state.range(0));
+    std::size_t bytes = 0;
+    for (auto _ : state)
+    {
+        const std::size_t before = g_allocated_bytes.load();
+        const FileItem drive = MakeVocabularyDrive(files, make_name);
+        bytes = g_allocated_bytes.load() - before;
+        benchmark::DoNotOptimize(&drive);
+    }
+    state.counters["heap_bytes/node"] = static_cast<double>(bytes) / static_cast<double>(files);
+    state.counters["node_bytes"] = static_cast<double>(sizeof(FileItem));
+}
+}
+
+static void BM_Names_Owned(benchmark::State& state)
+{
+    BuildVocabularyDrive(state, [](const std::string& name) { return std::string_view{name}; });
+}
+BENCHMARK(BM_Names_Owned)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BM_Names_Interned(benchmark::State& state)
+{
+    BuildVocabularyDrive(state, [](const std::string& name) { return Interned{name}; });
+    state.counters["pool_bytes"] = static_cast<double>(NamePool::Global().GetStats().bytes);
+}
+BENCHMARK(BM_Names_Interned)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+// full scans: count files and total name length
+static void BM_Scan_FileItem(benchmark::State& state)
+{
+    const FileItem drive = MakeWideDrive(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state)
+    {
+        std::size_t files = 0, name_bytes = 0;
+        drive.Recurse([&](const auto& fi, const Path&) {
+            files += std::is_same_v<std::remove_cvref_t<decltype(fi)>, File>;
+            name_bytes += fi.GetName().size();
+        });
+        benchmark::DoNotOptimize(files);
+        benchmark::DoNotOptimize(name_bytes);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Scan_FileItem)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BM_Scan_FlatTreeRecurse(benchmark::State& state)
+{
+    const FlatTree flat(MakeWideDrive(static_cast<std::size_t>(state.range(0))));
+    for (auto _ : state)
+    {
+        std::size_t files = 0, name_bytes = 0;
+        flat.Recurse([&](FlatTree::Node node, const Path&) {
+            files += node.GetKind() == NodeKind::File;
+            name_bytes += node.GetName().size();
+        });
+        benchmark::DoNotOptimize(files);
+        benchmark::DoNotOptimize(name_bytes);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Scan_FlatTreeRecurse)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BM_Scan_FlatTreeColumns(benchmark::State& state)
+{
+    const FlatTree flat(MakeWideDrive(static_cast<std::size_t>(state.range(0))));
+    for (auto _ : state)
+    {
+        std::size_t files = 0;
+        for (const NodeKind kind : flat.Kinds())
+            files += kind == NodeKind::File;
+        const std::size_t name_bytes = flat.NameBlob().size();
+        benchmark::DoNotOptimize(files);
+        benchmark::DoNotOptimize(name_bytes);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Scan_FlatTreeColumns)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BM_FindByName(benchmark::State& state)
+{
+    const FileItem drive = MakeWideDrive(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(drive.Find("c:/directory_number_500/file_number_700.txt"));
+}
+BENCHMARK(BM_FindByName)->Arg(1 << 20);
+
+// checksum every name; range(0) is the thread count
+static void BM_ParallelChecksum(benchmark::State& state)
+{
+    const FileItem drive = MakeWideDrive(1 << 20);
+    const ParallelOptions options{64, static_cast<int>(state.range(0))};
+    for (auto _ : state)
+    {
+        const std::uint64_t checksum = ParallelReduce(drive, std::uint64_t{0},
+            [](std::uint64_t& local, const auto& fi, const Path&) {
+                local += std::hash<std::string_view>{}(fi.GetName());
+            },
+            [](std::uint64_t a, std::uint64_t b) { return a + b; }, options);
+        benchmark::DoNotOptimize(checksum);
+    }
+    state.SetItemsProcessed(state.iterations() * (1 << 20));
+}
+BENCHMARK(BM_ParallelChecksum)->RangeMultiplier(2)->Range(1, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())))
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_SequentialChecksum(benchmark::State& state)
+{
+    const FileItem drive = MakeWideDrive(1 << 20);
+    for (auto _ : state)
+    {
+        std::uint64_t checksum = 0;
+        drive.Recurse([&checksum](const auto& fi, const Path&) { checksum += std::hash<std::string_view>{}(fi.GetName()); });
+        benchmark::DoNotOptimize(checksum);
+    }
+    state.SetItemsProcessed(state.iterations() * (1 << 20));
+}
+BENCHMARK(BM_SequentialChecksum)->Unit(benchmark::kMillisecond);
+
+// Printing a realistic 1M-node drive: the per-node iostream formatting operator<< used to
+// do, against TreePrinter into a string and into /dev/null.
+static void BM_Print_Iostream(benchmark::State& state)
+{
+    const GeneratedTree corpus = TreeGenerator{}.Realistic(1 << 20);
+    std::ostringstream os;
+    for (auto _ : state)
+    {
+        os.str({});
+        corpus.tree.Traverse([&os](const auto& fi, std::span<const int> path) {
+            for (std::size_t i = 0; i < path.size(); ++i)
+                os << "\t";
+            os << fi.GetName() << "\n";
+        });
+        benchmark::DoNotOptimize(os.tellp());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(corpus.nodes * state.iterations()));
+}
+BENCHMARK(BM_Print_Iostream)->Unit(benchmark::kMillisecond);
+
+static void BM_Print_TreePrinterString(benchmark::State& state)
+{
+    const GeneratedTree corpus = TreeGenerator{}.Realistic(1 << 20);
+    std::string out;
+    for (auto _ : state)
+    {
+        out.clear();
+        TreePrinter printer(StringSink{out});
+        printer.Print(corpus.tree);
+        printer.Flush();
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(corpus.nodes * state.iterations()));
+    state.SetBytesProcessed(static_cast<int64_t>(out.size() * state.iterations()));
+}
+BENCHMARK(BM_Print_TreePrinterString)->Unit(benchmark::kMillisecond);
+
+static void BM_Print_TreePrinterFd(benchmark::State& state)
+{
+    const GeneratedTree corpus = TreeGenerator{}.Realistic(1 << 20);
+    std::FILE* null = std::fopen("/dev/null", "w");
+    TreePrinter printer(FdSink{fileno(null)});
+    for (auto _ : state)
+    {
+        printer.Print(corpus.tree);
+        printer.Flush();
+    }
+    std::fclose(null);
+    state.SetItemsProcessed(static_cast<int64_t>(corpus.nodes * state.iterations()));
+}
+BENCHMARK(BM_Print_TreePrinterFd)->Unit(benchmark::kMillisecond);
+
+// Service start: rebuilding a realistic 1M-node drive against mapping a saved copy.
+static void BM_Startup_Build(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        GeneratedTree corpus = TreeGenerator{}.Realistic(1 << 20);
+        benchmark::DoNotOptimize(&corpus.tree[corpus.probe]);
+        state.PauseTiming();
+        { GeneratedTree discard = std::move(corpus); }
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_Startup_Build)->Unit(benchmark::kMillisecond);
+
+static void BM_Startup_Map(benchmark::State& state)
+{
+    const GeneratedTree corpus = TreeGenerator{}.Realistic(1 << 20);
+    const std::string filename = "/tmp/FileExampleBench.fitree";
+    TreeFile::Save(FlatTree(corpus.tree), filename);
+    for (auto _ : state)
+    {
+        const FlatTree mapped = TreeFile::Map(filename);
+        benchmark::DoNotOptimize(mapped[corpus.probe].GetName().data());
+    }
+    std::remove(filename.c_str());
+}
+BENCHMARK(BM_Startup_Map)->Unit(benchmark::kMicrosecond);
+
+// Scans $FILEEXAMPLE_SCAN_ROOT (default /usr); the first iteration runs against a cold
+// dentry cache only if the caller dropped it beforehand.
+static void BM_FilesystemScan(benchmark::State& state)
+{
+    const char* root = std::getenv("FILEEXAMPLE_SCAN_ROOT");
+    std::uint64_t entries = 0;
+    for (auto _ : state)
+    {
+        std::optional<TreeScanner> scanner;
+        scanner.emplace(root ? root : "/usr", 'c', ScanOptions{64, static_cast<int>(state.range(0))});
+        scanner->Start();
+        scanner->Wait();
+        entries += scanner->GetStats().entries;
+        state.PauseTiming();
+        scanner.reset();
+        state.ResumeTiming();
+    }
+    state.counters["entries/s"] = benchmark::Counter(static_cast<double>(entries), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_FilesystemScan)->RangeMultiplier(4)->Range(1, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())))
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Every thread looks the probe node up by path; thread 0 also renames it every
+// kWriteEvery lookups. The baseline is the global mutex the tree needs without
+// ConcurrentTree.
+namespace
+{
+constexpr std::uint64_t kWriteEvery = 64;
+
+const GeneratedTree& ContentionCorpus()
+{
+    static const GeneratedTree corpus = TreeGenerator{}.Make(TreeShape::Balanced, 1 << 16);
+    return corpus;
+}
+std::string_view ContentionName(std::uint64_t lookups)
+{
+    return (lookups / kWriteEvery) % 2 ? "renamed_a.txt" : "renamed_b.txt";
+}
+}
+
+static void BM_Contention_Mutex(benchmark::State& state)
+{
+    static std::mutex mutex;
+    static FileItem tree = ContentionCorpus().tree.Clone();
+    const Path& probe = ContentionCorpus().probe;
+    const bool writer = state.thread_index() == 0;
+    std::uint64_t lookups = 0;
+    for (auto _ : state)
+    {
+        std::lock_guard lock(mutex);
+        if (writer && ++lookups % kWriteEvery == 0)
+            tree[probe].Rename(ContentionName(lookups));
+        benchmark::DoNotOptimize(std::as_const(tree)[probe].GetName().size());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Contention_Mutex)->ThreadRange(1, static_cast<int>(std::max(1u, 2 * std::thread::hardware_concurrency())))
+    ->UseRealTime();
+
+static void BM_Contention_ConcurrentTree(benchmark::State& state)
+{
+    static ConcurrentTree tree(ContentionCorpus().tree.Clone());
+    const Path& probe = ContentionCorpus().probe;
+    const bool writer = state.thread_index() == 0;
+    std::uint64_t lookups = 0;
+    for (auto _ : state)
+    {
+        if (writer && ++lookups % kWriteEvery == 0)
+            tree.Rename(probe, ContentionName(lookups));
+        tree.Read([&probe](const FileItem& root) { benchmark::DoNotOptimize(root[probe].GetName().size()); });
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Contention_ConcurrentTree)->ThreadRange(1, static_cast<int>(std::max(1u, 2 * std::thread::hardware_concurrency())))
+    ->UseRealTime();
+
+// Extension normalisation: rename every file in one 200k-entry directory,
+// c:/Users/me/Pictures/photos.
+namespace
+{
+constexpr int kBatchFiles = 200000;
+
+FileItem MakePhotoDrive()
+{
+    std::pmr::vector<FileItem> photos;
+    photos.reserve(kBatchFiles);
+    for (int i = 0; i < kBatchFiles; ++i)
+        photos.emplace_back(File{"photo_" + std::to_string(i) + ".JPG"});
+    return Drive{'c', Directory{"Users", Directory{"me", Directory{"Pictures", Directory{"photos", std::move(photos)}}}}};
+}
+}
+
+static void BM_MassRename_Individual(benchmark::State& state)
+{
+    FileItem drive = MakePhotoDrive();
+    for (auto _ : state)
+        for (int i = 0; i < kBatchFiles; ++i)
+            drive[Path{0, 0, 0, 0, i}].Rename("photo.jpg");
+    state.SetItemsProcessed(state.iterations() * kBatchFiles);
+}
+BENCHMARK(BM_MassRename_Individual)->Unit(benchmark::kMillisecond);
+
+static void BM_MassRename_Batch(benchmark::State& state)
+{
+    FileItem drive = MakePhotoDrive();
+    for (auto _ : state)
+    {
+        TreeBatch batch;
+        batch.Reserve(kBatchFiles, 5);
+        for (int i = 0; i < kBatchFiles; ++i)
+        {
+            const int path[] = {0, 0, 0, 0, i};
+            batch.Rename(path, "photo.jpg");
+        }
+        batch.Apply(drive);
+    }
+    state.SetItemsProcessed(state.iterations() * kBatchFiles);
+}
+BENCHMARK(BM_MassRename_Batch)->Unit(benchmark::kMillisecond);
+
+// Probing lookups where 30% of the paths miss, through the throwing and the Try API.
+namespace
+{
+std::vector<Path> ProbePaths(const GeneratedTree& corpus)
+{
+    std::vector<Path> probes;
+    for (int i = 0; i < 1000; ++i)
+    {
+        Path probe = corpus.probe;
+        if (i % 10 < 3)
+            probe.back() = 1 << 30;
+        probes.push_back(std::move(probe));
+    }
+    return probes;
+}
+}
+
+static void BM_ProbeLookup_Throwing(benchmark::State& state)
+{
+    const GeneratedTree& corpus = CoreTree(TreeShape::Balanced);
+    const std::vector<Path> probes = ProbePaths(corpus);
+    const FileItem& tree = corpus.tree;
+    for (auto _ : state)
+        for (const Path& probe : probes)
+        {
+            try { benchmark::DoNotOptimize(&tree[probe]); }
+            catch (const NonExist&) {}
+        }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(probes.size()));
+}
+BENCHMARK(BM_ProbeLookup_Throwing);
+
+static void BM_ProbeLookup_TryGet(benchmark::State& state)
+{
+    const GeneratedTree& corpus = CoreTree(TreeShape::Balanced);
+    const std::vector<Path> probes = ProbePaths(corpus);
+    const FileItem& tree = corpus.tree;
+    for (auto _ : state)
+        for (const Path& probe : probes)
+            benchmark::DoNotOptimize(tree.TryGet(probe));
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(probes.size()));
+}
+BENCHMARK(BM_ProbeLookup_TryGet);
+
+// Per-level cost of resolving a Path down a 1024-deep chain: the std::visit dispatch that
+// operator[](int) used to do, against the capability-table fast path. items/s is levels/s.
+namespace
+{
+const FileItem* VisitTryGet(const FileItem& fi, int idx)
+{
+    return std::visit([idx](const auto& item)->const FileItem* {
+        if constexpr (std::is_base_of_v<ContainerFileItem, std::remove_cvref_t<decltype(item)>>)
+            return item.TryGet(idx);
+        else
+            return nullptr;
+    }, static_cast<const FileItemVariant&>(fi));
+}
+const GeneratedTree& LevelCorpus()
+{
+    static const GeneratedTree corpus = TreeGenerator{}.Deep(1024);
+    return corpus;
+}
+}
+
+static void BM_PathLevel_Visit(benchmark::State& state)
+{
+    const GeneratedTree& corpus = LevelCorpus();
+    for (auto _ : state)
+    {
+        const FileItem* current = &corpus.tree;
+        for (int idx : corpus.probe)
+            current = VisitTryGet(*current, idx);
+        benchmark::DoNotOptimize(current);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(corpus.probe.size()));
+}
+BENCHMARK(BM_PathLevel_Visit);
+
+static void BM_PathLevel_Table(benchmark::State& state)
+{
+    const GeneratedTree& corpus = LevelCorpus();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(corpus.tree.TryGet(corpus.probe));
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(corpus.probe.size()));
+}
+BENCHMARK(BM_PathLevel_Table);
+
+// "How many files under this drive": a full Recurse, the cached aggregates, and the cached
+// aggregates after a rename dirties the spine to the probe.
+static void BM_Summary_Recurse(benchmark::State& state)
+{
+    const GeneratedTree& corpus = CoreTree(TreeShape::Realistic);
+    for (auto _ : state)
+    {
+        std::uint64_t files = 0;
+        corpus.tree.Recurse([&files](const auto& fi, const Path&) {
+            files += std::is_same_v<std::remove_cvref_t<decltype(fi)>, File>;
+        });
+        benchmark::DoNotOptimize(files);
+    }
+}
+BENCHMARK(BM_Summary_Recurse)->Unit(benchmark::kMicrosecond);
+
+static void BM_Summary_Cached(benchmark::State& state)
+{
+    const GeneratedTree& corpus = CoreTree(TreeShape::Realistic);
+    benchmark::DoNotOptimize(corpus.tree.Aggregates().files);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(corpus.tree.Aggregates().files);
+}
+BENCHMARK(BM_Summary_Cached)->Unit(benchmark::kMicrosecond);
+
+static void BM_Summary_AfterRename(benchmark::State& state)
+{
+    GeneratedTree& corpus = CoreTree(TreeShape::Realistic);
+    const std::string original{corpus.tree[corpus.probe].GetName()};
+    benchmark::DoNotOptimize(corpus.tree.Aggregates().files);
+    for (auto _ : state)
+    {
+        corpus.tree[corpus.probe].Rename(original);
+        benchmark::DoNotOptimize(corpus.tree.Aggregates().files);
+    }
+}
+BENCHMARK(BM_Summary_AfterRename)->Unit(benchmark::kMicrosecond);
+
+// "How many bytes, and how many files changed since t": walking the tree against streaming
+// FlatTree's attribute columns.
+static void BM_Attributes_SumSizes_Recurse(benchmark::State& state)
+{
+    const GeneratedTree& corpus = CoreTree(TreeShape::Realistic);
+    for (auto _ : state)
+    {
+        std::uint64_t bytes = 0;
+        corpus.tree.Recurse([&bytes](const auto& fi, const Path&) {
+            if constexpr (std::is_same_v<std::remove_cvref_t<decltype(fi)>, File>)
+                bytes += fi.GetAttributes().size;
+        });
+        benchmark::DoNotOptimize(bytes);
+    }
+}
+BENCHMARK(BM_Attributes_SumSizes_Recurse)->Unit(benchmark::kMicrosecond);
+
+static void BM_Attributes_SumSizes_Columns(benchmark::State& state)
+{
+    const FlatTree flat(CoreTree(TreeShape::Realistic).tree);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(flat.TotalSize());
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(flat.Sizes().size_bytes()));
+}
+BENCHMARK(BM_Attributes_SumSizes_Columns)->Unit(benchmark::kMicrosecond);
+
+static void BM_Attributes_ModifiedAfter_Columns(benchmark::State& state)
+{
+    const FlatTree flat(CoreTree(TreeShape::Realistic).tree);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(flat.CountModifiedAfter(1'650'000'000'000'000'000));
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(flat.MTimes().size_bytes()));
+}
+BENCHMARK(BM_Attributes_ModifiedAfter_Columns)->Unit(benchmark::kMicrosecond);
+
+// "Find every name matching": the Recurse walk over the tree against the blob kernels of a
+// FlatTree. Bytes processed is the name blob size for all three, so they compare in GB/s.
+static constexpr std::pair<NameMatch, std::string_view> kNameQueries[] = {
+    {NameMatch::Substring, "file_123"}, {NameMatch::Suffix, ".md"}, {NameMatch::Glob, "source_file_*7.cpp"},
+};
+
+static void BM_NameSearch_Walk(benchmark::State& state)
+{
+    const GeneratedTree& corpus = CoreTree(TreeShape::Realistic);
+    const auto& [match, pattern] = kNameQueries[state.range(0)];
+    const NameSearch search(match, pattern);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(search.FindPaths(corpus.tree).size());
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(FlatTree(corpus.tree).NameBlob().size()));
+    state.SetLabel(std::string(pattern));
+}
+BENCHMARK(BM_NameSearch_Walk)->DenseRange(0, std::size(kNameQueries) - 1)->Unit(benchmark::kMillisecond);
+
+static void NameSearchBlob(benchmark::State& state, NameKernel kernel)
+{
+    const FlatTree flat(CoreTree(TreeShape::Realistic).tree);
+    const auto& [match, pattern] = kNameQueries[state.range(0)];
+    const NameSearch search(match, pattern);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(search.FindPaths(flat, kernel).size());
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(flat.NameBlob().size()));
+    state.SetLabel(std::string(pattern));
+}
+static void BM_NameSearch_Scalar(benchmark::State& state) { NameSearchBlob(state, NameKernel::Scalar); }
+BENCHMARK(BM_NameSearch_Scalar)->DenseRange(0, std::size(kNameQueries) - 1)->Unit(benchmark::kMillisecond);
+static void BM_NameSearch_Vector(benchmark::State& state) { NameSearchBlob(state, NameKernel::Vector); }
+BENCHMARK(BM_NameSearch_Vector)->DenseRange(0, std::size(kNameQueries) - 1)->Unit(benchmark::kMillisecond);
+
+// One very large directory of dated log names: bytes held by a Directory (with the name index
+// Find builds) against a SortedDirectory, and the cost of a name lookup in each.
+namespace
+{
+class LiveBytesResource : public std::pmr::memory_resource
+{
+    std::size_t m_live{0};
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        m_live += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        m_live -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+public:
+    std::size_t Live() const { return m_live; }
+};
+
+constexpr std::size_t kLogFiles = 1 << 18;
+
+std::string LogName(std::size_t i)
+{
+    char name[64];
+    std::snprintf(name, sizeof name, "app-log-2026-10-%02zu-%06zu.txt", 1 + i % 28, i);
+    return name;
+}
+Directory LogDirectory(const FileItem::allocator_type& alloc)
+{
+    Directory logs("logs", alloc);
+    logs.Reserve(static_cast<int>(kLogFiles));
+    for (std::size_t i = 0; i < kLogFiles; ++i)
+        logs.Emplace<File>(LogName(i));
+    return logs;
+}
+std::vector<std::string> LogProbes()
+{
+    std::vector<std::string> probes;
+    for (std::size_t i = 0; i < 4096; ++i)
+        probes.push_back(LogName(i * 7919 % kLogFiles));
+    return probes;
+}
+}
+
+static void BM_LargeDirectory_Find_Directory(benchmark::State& state)
+{
+    LiveBytesResource resource;
+    const Directory logs = LogDirectory(&resource);
+    const std::vector<std::string> probes = LogProbes();
+    std::size_t i = 0;
+    benchmark::DoNotOptimize(logs.Find(probes[0]));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(logs.Find(probes[i++ % probes.size()]));
+    // the name index lives in the default resource; count its nodes at a pointer and a padded
+    // (hash, int) pair each, plus the bucket array
+    const std::size_t index_bytes = kLogFiles * (sizeof(void*) + sizeof(std::pair<std::uint64_t, int>) + sizeof(void*));
+    state.counters["bytes/entry"] = static_cast<double>(resource.Live() + index_bytes) / kLogFiles;
+}
+BENCHMARK(BM_LargeDirectory_Find_Directory);
+
+// Insert-if-absent into one directory, the pattern of a scanner merging a listing: each Find
+// must use the index the previous AddChild extended, not rebuild it.
+static void BM_LargeDirectory_FindThenAdd(benchmark::State& state)
+{
+    const int files = static_cast<int>(state.range(0));
+    for (auto _ : state)
+    {
+        Directory logs{"logs"};
+        for (int i = 0; i < files; ++i)
+        {
+            const std::string name = LogName(static_cast<std::size_t>(i));
+            if (std::as_const(logs).Find(name) < 0)
+                logs.AddChild(File{name});
+        }
+        benchmark::DoNotOptimize(logs.Size());
+    }
+    state.SetItemsProcessed(state.iterations() * files);
+}
+BENCHMARK(BM_LargeDirectory_FindThenAdd)->Arg(2048)->Arg(8192)->Arg(32768)->Unit(benchmark::kMillisecond);
+
+// Lookups in one directory interleaved with renames in an unrelated tree, which must not
+// cost the directory its index.
+static void BM_LargeDirectory_FindBesideRenames(benchmark::State& state)
+{
+    LiveBytesResource resource;
+    const Directory logs = LogDirectory(&resource);
+    const std::vector<std::string> probes = LogProbes();
+    FileItem other = Drive{'b', {File{"a"}}};
+    std::size_t i = 0;
+    for (auto _ : state)
+    {
+        other[Path{0}].Rename(i % 2 ? "a" : "b");
+        benchmark::DoNotOptimize(logs.Find(probes[i++ % probes.size()]));
+    }
+}
+BENCHMARK(BM_LargeDirectory_FindBesideRenames);
+
+static void BM_LargeDirectory_Find_Sorted(benchmark::State& state)
+{
+    LiveBytesResource resource;
+    const SortedDirectory logs(LogDirectory(&resource), &resource);
+    const std::vector<std::string> probes = LogProbes();
+    std::size_t i = 0;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(logs.Find(probes[i++ % probes.size()]));
+    state.counters["bytes/entry"] = static_cast<double>(resource.Live()) / kLogFiles;
+    state.counters["name_bytes/entry"] = static_cast<double>(logs.NameBytes()) / kLogFiles;
+}
+BENCHMARK(BM_LargeDirectory_Find_Sorted);
+
+static void BM_LargeDirectory_Visit_Sorted(benchmark::State& state)
+{
+    const SortedDirectory logs(LogDirectory({}));
+    for (auto _ : state)
+    {
+        std::size_t bytes = 0;
+        logs.Visit([&bytes](std::string_view name, const FileItem&) { bytes += name.size(); });
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(kLogFiles));
+}
+BENCHMARK(BM_LargeDirectory_Visit_Sorted)->Unit(benchmark::kMillisecond);
+
+// A hot loop over nodes that callers hold on to: re-resolving each Path from the root against
+// resolving a NodeHandle, on the realistic drive (depth 3) and the 1024-deep chain.
+namespace
+{
+std::vector<Path> HeldPaths(const GeneratedTree& corpus)
+{
+    std::vector<Path> paths;
+    std::mt19937 rng(5);
+    for (int i = 0; i < 1024; ++i)
+    {
+        Path path;
+        for (const FileItem* node = &corpus.tree; node->IsContainer() && node->AsContainer()->Size() > 0;)
+        {
+            const int size = node->AsContainer()->Size();
+            path.push_back(static_cast<int>(rng() % static_cast<unsigned>(size)));
+            node = node->AsContainer()->TryGet(path.back());
+        }
+        paths.push_back(std::move(path));
+    }
+    return paths;
+}
+GeneratedTree& HandleCorpus(int shape)
+{
+    static GeneratedTree realistic = TreeGenerator{}.Realistic(1 << 20);
+    static GeneratedTree deep = TreeGenerator{}.Deep(1024);
+    return shape == 0 ? realistic : deep;
+}
+}
+
+static void BM_HeldNodes_Paths(benchmark::State& state)
+{
+    const GeneratedTree& corpus = HandleCorpus(static_cast<int>(state.range(0)));
+    const std::vector<Path> paths = HeldPaths(corpus);
+    for (auto _ : state)
+        for (const Path& path : paths)
+            benchmark::DoNotOptimize(corpus.tree.TryGet(path));
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(paths.size()));
+}
+BENCHMARK(BM_HeldNodes_Paths)->Arg(0)->Arg(1);
+
+static void BM_HeldNodes_Handles(benchmark::State& state)
+{
+    GeneratedTree& corpus = HandleCorpus(static_cast<int>(state.range(0)));
+    const NodeTable table(corpus.tree);
+    std::vector<NodeHandle> handles;
+    for (const Path& path : HeldPaths(corpus))
+        handles.push_back(table.Find(path));
+    for (auto _ : state)
+        for (const NodeHandle handle : handles)
+            benchmark::DoNotOptimize(table.TryResolve(handle));
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(handles.size()));
+}
+BENCHMARK(BM_HeldNodes_Handles)->Arg(0)->Arg(1);
+
+// Yesterday's snapshot against today's drive after 16 renames: the diff that skips shared
+// subtrees, and the same diff between trees that share nothing (a full double walk).
+namespace
+{
+struct DiffCorpus
+{
+    FileItem    yesterday;
+    FileItem    today;
+};
+const DiffCorpus& EditedCorpus()
+{
+    static const DiffCorpus corpus = [] {
+        GeneratedTree generated = TreeGenerator{}.Realistic(1 << 20);
+        FileItem yesterday = generated.tree;
+        std::mt19937 rng(3);
+        for (int i = 0; i < 16; ++i)
+        {
+            const int project = static_cast<int>(rng() % static_cast<unsigned>(generated.tree.AsContainer()->Size()));
+            const Path version{project, 0};
+            if (generated.tree[version].AsContainer()->Size() > 0)
+                generated.tree[(Path{project, 0, 0})].Rename("edited_" + std::to_string(i));
+        }
+        return DiffCorpus{std::move(yesterday), std::move(generated.tree)};
+    }();
+    return corpus;
+}
+}
+
+static void BM_Diff_SharedSnapshot(benchmark::State& state)
+{
+    const DiffCorpus& corpus = EditedCorpus();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(TreeDiff(corpus.yesterday, corpus.today).Changes().size());
+}
+BENCHMARK(BM_Diff_SharedSnapshot)->Unit(benchmark::kMicrosecond);
+
+static void BM_Diff_NothingShared(benchmark::State& state)
+{
+    const DiffCorpus& corpus = EditedCorpus();
+    const FileItem unshared = corpus.yesterday.Clone();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(TreeDiff(unshared, corpus.today).Changes().size());
+}
+BENCHMARK(BM_Diff_NothingShared)->Unit(benchmark::kMillisecond);
+
+// Merkle digest of the realistic drive from cold caches, sequentially and with
+// ParallelDigest, then after one rename, which rehashes only the spine.
+static void DigestCold(benchmark::State& state, bool parallel)
+{
+    const GeneratedTree& corpus = CoreTree(TreeShape::Realistic);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::optional<FileItem> cold(corpus.tree.Clone());
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(parallel ? ParallelDigest(*cold) : cold->Digest());
+        state.PauseTiming();
+        cold.reset();
+        state.ResumeTiming();
+    }
+}
+static void BM_Digest_Sequential(benchmark::State& state) { DigestCold(state, false); }
+BENCHMARK(BM_Digest_Sequential)->Unit(benchmark::kMillisecond);
+static void BM_Digest_Parallel(benchmark::State& state) { DigestCold(state, true); }
+BENCHMARK(BM_Digest_Parallel)->Unit(benchmark::kMillisecond);
+
+static void BM_Digest_AfterRename(benchmark::State& state)
+{
+    GeneratedTree& corpus = CoreTree(TreeShape::Realistic);
+    const std::string original{corpus.tree[corpus.probe].GetName()};
+    benchmark::DoNotOptimize(corpus.tree.Digest());
+    for (auto _ : state)
+    {
+        corpus.tree[corpus.probe].Rename(original);
+        benchmark::DoNotOptimize(corpus.tree.Digest());
+    }
+}
+BENCHMARK(BM_Digest_AfterRename)->Unit(benchmark::kMicrosecond);
+
+static void BM_Diff_NothingSharedDigests(benchmark::State& state)
+{
+    const DiffCorpus& corpus = EditedCorpus();
+    const FileItem unshared = corpus.yesterday.Clone();
+    benchmark::DoNotOptimize(TreeDiff(unshared, corpus.today, DiffOptions{true}).Changes().size());
+    for (auto _ : state)
+        benchmark::DoNotOptimize(TreeDiff(unshared, corpus.today, DiffOptions{true}).Changes().size());
+}
+BENCHMARK(BM_Diff_NothingSharedDigests)->Unit(benchmark::kMicrosecond);
+
+// Pulling the realistic drive through the WalkGenerator(), for comparison with Recurse.
+static void BM_Walk_Generator(benchmark::State& state)
+{
+    const GeneratedTree& corpus = CoreTree(TreeShape::Realistic);
+    const std::size_t before = g_allocations.load();
+    for (auto _ : state)
+    {
+        std::size_t nodes = 0;
+        for (const WalkedNode& entry : WalkGenerator(corpus.tree))
+        {
+            benchmark::DoNotOptimize(entry.path.data());
+            ++nodes;
+        }
+        benchmark::DoNotOptimize(nodes);
+    }
+    ReportPerNode(state, corpus.nodes, g_allocations.load() - before);
+}
+BENCHMARK(BM_Walk_Generator)->Unit(benchmark::kMillisecond);
+
+// One 100us request per node of a 2000-node tree, waited for in turn from Recurse, then
+// overlapped by WalkAsync with the given number in flight.
+namespace
+{
+constexpr std::chrono::microseconds kIoLatency{100};
+
+struct SimulatedIo
+{
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> visit) const
+    {
+        std::thread([visit] {
+            std::this_thread::sleep_for(kIoLatency);
+            visit.resume();
+        }).detach();
+    }
+    void await_resume() const noexcept {}
+};
+
+const GeneratedTree& IoTree()
+{
+    static const GeneratedTree tree = TreeGenerator{}.Realistic(2000);
+    return tree;
+}
+}
+
+static void BM_IoVisits_Sequential(benchmark::State& state)
+{
+    const GeneratedTree& corpus = IoTree();
+    for (auto _ : state)
+        corpus.tree.Recurse([](const auto&, const Path&) { std::this_thread::sleep_for(kIoLatency); });
+    state.SetItemsProcessed(static_cast<int64_t>(corpus.nodes * state.iterations()));
+}
+BENCHMARK(BM_IoVisits_Sequential)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_IoVisits_Async(benchmark::State& state)
+{
+    const GeneratedTree& corpus = IoTree();
+    for (auto _ : state)
+        WalkAsync(corpus.tree, [](const FileItem&, Path) -> AsyncVisit { co_await SimulatedIo{}; }, state.range(0));
+    state.SetItemsProcessed(static_cast<int64_t>(corpus.nodes * state.iterations()));
+}
+BENCHMARK(BM_IoVisits_Async)->Arg(1)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Bytes held by a realistic tree of a million files in the layout this binary was built with
+// (configure with -DFILEEXAMPLE_COMPACT_NODES=ON for the compact one): the nodes, vectors and
+// names in the tree's resource, plus what the tree added to the NamePool, its names and their
+// slot and hash entry. Names already pooled by an earlier benchmark are not counted, so run
+// it on its own.
+static void BM_Memory_PerMillionFiles(benchmark::State& state)
+{
+    constexpr std::size_t kFiles = 1'000'000;
+    constexpr std::size_t kPoolEntryBytes = sizeof(std::string_view) + sizeof(std::string_view) + sizeof(NamePool::Id) + 2 * sizeof(void*);
+    for (auto _ : state)
+    {
+        LiveBytesResource resource;
+        const NamePool::Stats before = NamePool::Global().GetStats();
+        const auto start = std::chrono::steady_clock::now();
+        std::optional<GeneratedTree> corpus(TreeGenerator{&resource}.Realistic(kFiles));
+        state.counters["build_ms"] = MillisecondsSince(start);
+        const NamePool::Stats after = NamePool::Global().GetStats();
+        const std::size_t names = after.names - before.names;
+        const std::size_t pool = after.bytes - before.bytes + names * (1 + kPoolEntryBytes);
+        state.counters["tree_MB"] = static_cast<double>(resource.Live()) / 1e6;
+        state.counters["pool_MB"] = static_cast<double>(pool) / 1e6;
+        state.counters["bytes/file"] = static_cast<double>(resource.Live() + pool) / kFiles;
+        corpus.reset();
+    }
+    state.counters["sizeof_node"] = sizeof(FileItem);
+}
+BENCHMARK(BM_Memory_PerMillionFiles)->Unit(benchmark::kMillisecond)->Iterations(1);
+
+// Re-layout of a realistic drive of 200k files: the first version of each of the first 256
+// projects is moved under the last project, by deep copy and removal (what a job that cannot
+// splice does) and by FileItem::Move. Every iteration starts from a fresh clone, untimed.
+namespace
+{
+constexpr int kRelayoutMoves = 256;
+
+void Relayout(benchmark::State& state, bool splice)
+{
+    static const GeneratedTree corpus = TreeGenerator{}.Realistic(200000);
+    const int projects = corpus.tree.AsContainer()->Size();
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::optional<FileItem> tree(corpus.tree.Clone());
+        state.ResumeTiming();
+        const Path archive{projects - 1};
+        for (int p = 0; p < kRelayoutMoves; ++p)
+        {
+            const Path version{p, 0};
+            if (splice)
+                tree->Move(version, archive);
+            else
+            {
+                FileItem copy = (*tree)[version].Clone();
+                (*tree)[Path{p}].AsContainer()->RemoveChild(0);
+                (*tree)[archive].AsContainer()->AddChild(std::move(copy));
+            }
+        }
+        state.PauseTiming();
+        tree.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(kRelayoutMoves * state.iterations());
+}
+}
+static void BM_Relayout_CopyAndRemove(benchmark::State& state) { Relayout(state, false); }
+BENCHMARK(BM_Relayout_CopyAndRemove)->Unit(benchmark::kMillisecond)->Iterations(20);
+static void BM_Relayout_Move(benchmark::State& state) { Relayout(state, true); }
+BENCHMARK(BM_Relayout_Move)->Unit(benchmark::kMicrosecond)->Iterations(20);
+
+// Sorting a directory of 64k shuffled log files by name: std::sort swapping the nodes
+// themselves, against SortByName.
+namespace
+{
+std::pmr::vector<FileItem> ShuffledLogs()
+{
+    std::pmr::vector<FileItem> files;
+    for (std::size_t i = 0; i < kLogFiles / 4; ++i)
+        files.emplace_back(File{LogName(i * 2654435761u % kLogFiles)});
+    std::shuffle(files.begin(), files.end(), std::mt19937(7));
+    return files;
+}
+}
+
+static void BM_SortDirectory_SwapNodes(benchmark::State& state)
+{
+    const std::pmr::vector<FileItem> shuffled = ShuffledLogs();
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::pmr::vector<FileItem> files = shuffled;
+        state.ResumeTiming();
+        std::sort(files.begin(), files.end(), [](const FileItem& a, const FileItem& b) { return a.GetName() < b.GetName(); });
+        benchmark::DoNotOptimize(files.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(shuffled.size() * state.iterations()));
+}
+BENCHMARK(BM_SortDirectory_SwapNodes)->Unit(benchmark::kMillisecond);
+
+static void BM_SortDirectory_SortByName(benchmark::State& state)
+{
+    const std::pmr::vector<FileItem> shuffled = ShuffledLogs();
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        Directory logs{"logs", std::pmr::vector<FileItem>(shuffled)};
+        state.ResumeTiming();
+        logs.SortByName();
+        benchmark::DoNotOptimize(&logs);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(shuffled.size() * state.iterations()));
+}
+BENCHMARK(BM_SortDirectory_SortByName)->Unit(benchmark::kMillisecond);
+
+// Dropping a realistic drive of a million files, as the caller sees it: the destructor,
+// ParallelDestroy, handing it to a TreeReclaimer (destroyed untimed before the next
+// iteration), and in a TreeArena, the destructor against Discard, both followed by the
+// arena's own destruction.
+namespace
+{
+constexpr std::size_t kTeardownFiles = 1'000'000;
+
+enum class Teardown { Destructor, Parallel, Reclaimer };
+
+void TeardownHeap(benchmark::State& state, Teardown how)
+{
+    TreeReclaimer reclaimer;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::optional<FileItem> tree(TreeGenerator{}.Realistic(kTeardownFiles).tree);
+        state.ResumeTiming();
+        switch (how)
+        {
+        case Teardown::Destructor:  tree.reset(); break;
+        case Teardown::Parallel:    ParallelDestroy(std::move(*tree)); break;
+        case Teardown::Reclaimer:   reclaimer.Retire(std::move(*tree)); break;
+        }
+        state.PauseTiming();
+        tree.reset();
+        reclaimer.Drain();
+        state.ResumeTiming();
+    }
+}
+
+void TeardownArena(benchmark::State& state, bool discard)
+{
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto arena = std::make_unique<TreeArena>();
+        std::optional<FileItem> tree(TreeGenerator{arena->Allocator()}.Realistic(kTeardownFiles).tree);
+        state.ResumeTiming();
+        if (discard)
+            arena->Discard(std::move(*tree));
+        tree.reset();
+        arena.reset();
+    }
+}
+}
+static void BM_Teardown_Destructor(benchmark::State& state) { TeardownHeap(state, Teardown::Destructor); }
+BENCHMARK(BM_Teardown_Destructor)->Unit(benchmark::kMillisecond)->Iterations(3);
+static void BM_Teardown_ParallelDestroy(benchmark::State& state) { TeardownHeap(state, Teardown::Parallel); }
+BENCHMARK(BM_Teardown_ParallelDestroy)->Unit(benchmark::kMillisecond)->Iterations(3);
+static void BM_Teardown_Reclaimer(benchmark::State& state) { TeardownHeap(state, Teardown::Reclaimer); }
+BENCHMARK(BM_Teardown_Reclaimer)->Unit(benchmark::kMicrosecond)->Iterations(3);
+static void BM_Teardown_ArenaDestructor(benchmark::State& state) { TeardownArena(state, false); }
+BENCHMARK(BM_Teardown_ArenaDestructor)->Unit(benchmark::kMillisecond)->Iterations(3);
+static void BM_Teardown_ArenaDiscard(benchmark::State& state) { TeardownArena(state, true); }
+BENCHMARK(BM_Teardown_ArenaDiscard)->Unit(benchmark::kMillisecond)->Iterations(3);
+
+// Rebuilding a mutable tree from the FlatTree of the realistic drive, sequentially and with
+// ParallelMaterialize.
+static void BuildFromFlat(benchmark::State& state, bool parallel)
+{
+    const FlatTree flat(CoreTree(TreeShape::Realistic).tree);
+    for (auto _ : state)
+    {
+        std::optional<FileItem> built(parallel ? ParallelMaterialize(flat) : flat.Materialize());
+        benchmark::DoNotOptimize(&*built);
+        state.PauseTiming();
+        built.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(flat.Size() * state.iterations()));
+}
+static void BM_Build_Materialize(benchmark::State& state) { BuildFromFlat(state, false); }
+BENCHMARK(BM_Build_Materialize)->Unit(benchmark::kMillisecond);
+static void BM_Build_ParallelMaterialize(benchmark::State& state) { BuildFromFlat(state, true); }
+BENCHMARK(BM_Build_ParallelMaterialize)->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv)
+{
+    RegisterCoreSuite();
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
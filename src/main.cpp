@@ -1,207 +1,1702 @@
 #include <gtest/gtest.h>
-#include <variant>
-#include <stack>
-#include <vector>
-#include <span>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <map>
+#include <set>
+#include "FileItem.h"
+#include "TreeWalker.h"
+#include "TreeArena.h"
+#include "FlatTree.h"
+#include "PathCache.h"
+#include "ParallelRecurse.h"
+#include "TreePrinter.h"
+#include "TreeFile.h"
+#include "TreeScanner.h"
+#include "ConcurrentTree.h"
+#include "TreeBatch.h"
+#include "TreeGenerators.h"
+#include "NameSearch.h"
+#include "SortedDirectory.h"
+#include "NodeTable.h"
+#include "TreeMetrics.h"
+#include "TreeDiff.h"
+#include "TreeCoroutines.h"
+#include "TreeReclaimer.h"
 
-using FileItemVariant = std::variant<class Drive, class File, class Directory>;
-using Path = std::vector<int>;
-struct NonExist : std::runtime_error {NonExist():std::runtime_error("Does not exist"){}};
-struct CannotRename : std::runtime_error {CannotRename():std::runtime_error("Cannot rename"){}};
+TEST(FileItem,Get)
+{
+    File animal_file{"Aardvark"};
+    Directory animal_files{"Animals", 
+        {FileItem{animal_file}}
+    };
+    FileItem drive_a = Drive{'a', 
+        {animal_files}
+    };
+    std::cout << drive_a;
+    const auto& dir = std::get<Directory>(drive_a[0]);
+    ASSERT_THROW(drive_a[1], NonExist);
+    ASSERT_STREQ(dir.GetName().data(), "Animals");
+    const auto file = std::get<File>(dir.Get(0));
+    ASSERT_STREQ(file.GetName().data(), "Aardvark");
+}
 
-class FileItem;
 
+TEST(FileItem,GetPath)
+{
+    File animal_file{"Aardvark"};
+    Directory animal_files{"Animals", 
+        {animal_file}
+    };
+    FileItem drive_a = Drive{'a', 
+        {animal_files}
+    };
+    const auto& dir = std::get<Directory>(drive_a[Path{0}]);
+    ASSERT_STREQ(dir.GetName().data(), "Animals");
+    ASSERT_THROW(drive_a[Path{1}], NonExist);
+    const auto& file = std::get<File>(drive_a[Path{0,0}]);
+    ASSERT_STREQ(file.GetName().data(), "Aardvark");
+    ASSERT_THROW((drive_a[Path{0,1}]), NonExist);
 
-class NamedFileItem
+    drive_a[Path{0,0}].Rename("Antalope");
+    ASSERT_STREQ(file.GetName().data(), "Antalope");
+}
+
+TEST(FileItem,Traverse)
 {
-    std::string m_name;
-public:
-    NamedFileItem() = default;
-    NamedFileItem(std::string_view name):m_name(name) {}
+    FileItem drive_a = Drive{'a', {
+        Directory{"Animals", {File{"Aardvark"}, File{"Badger"}}},
+        File{"Zebra"}
+    }};
+    std::vector<std::pair<std::string, Path>> visited;
+    drive_a.Traverse([&visited](const auto& fi, std::span<const int> path) {
+        visited.emplace_back(std::string{fi.GetName()}, Path(path.begin(), path.end()));
+    });
+    const std::vector<std::pair<std::string, Path>> expected{
+        {"a", {}}, {"Animals", {0}}, {"Aardvark", {0,0}}, {"Badger", {0,1}}, {"Zebra", {1}}};
+    ASSERT_EQ(visited, expected);
+
+    std::vector<Path> recursed;
+    drive_a.Recurse([&recursed](const auto&, Path path) { recursed.push_back(path); });
+    ASSERT_EQ(recursed.size(), expected.size());
+    for (size_t i = 0; i < recursed.size(); ++i)
+        ASSERT_EQ(recursed[i], expected[i].second);
+}
+
+namespace
+{
+FileItem MakeWalkDrive()
+{
+    return Drive{'a', {
+        Directory{"Animals", {File{"Aardvark"}, Directory{"Birds", {File{"Crow"}}}}},
+        File{"Zebra"}
+    }};
+}
+template<class Root>
+std::vector<std::string> WalkNames(const Root& root, WalkOrder order)
+{
+    std::vector<std::string> names;
+    Walk(root, [&names](const auto& fi, std::span<const int>) { names.emplace_back(fi.GetName()); }, order);
+    return names;
+}
+}
+
+TEST(TreeWalker,Order)
+{
+    const FileItem drive_a = MakeWalkDrive();
+    ASSERT_EQ(WalkNames(drive_a, WalkOrder::PreOrder),
+        (std::vector<std::string>{"a", "Animals", "Aardvark", "Birds", "Crow", "Zebra"}));
+    ASSERT_EQ(WalkNames(drive_a, WalkOrder::PostOrder),
+        (std::vector<std::string>{"Aardvark", "Crow", "Birds", "Animals", "Zebra", "a"}));
+
+    const auto& animals = std::get<Directory>(std::get<Drive>(drive_a).Get(0));
+    ASSERT_EQ(WalkNames(animals, WalkOrder::PreOrder),
+        (std::vector<std::string>{"Animals", "Aardvark", "Birds", "Crow"}));
+    const File zebra{"Zebra"};
+    ASSERT_EQ(WalkNames(zebra, WalkOrder::PostOrder), (std::vector<std::string>{"Zebra"}));
+}
 
-    std::string_view GetName() const { return std::string_view{m_name}; }
-    void SetName(std::string_view n) { m_name = n; }
+TEST(TreeWalker,PruneAndStop)
+{
+    const FileItem drive_a = MakeWalkDrive();
+    std::vector<std::string> names;
+    Walk(drive_a, [&names](const auto& fi, std::span<const int>) {
+        names.emplace_back(fi.GetName());
+        return fi.GetName() == "Birds" ? WalkAction::Prune : WalkAction::Continue;
+    });
+    ASSERT_EQ(names, (std::vector<std::string>{"a", "Animals", "Aardvark", "Birds", "Zebra"}));
+
+    Path found;
+    int visited = 0;
+    const bool completed = Walk(drive_a, [&](const auto& fi, std::span<const int> path) {
+        ++visited;
+        if (fi.GetName() != "Crow")
+            return WalkAction::Continue;
+        found.assign(path.begin(), path.end());
+        return WalkAction::Stop;
+    });
+    ASSERT_FALSE(completed);
+    ASSERT_EQ(visited, 5);
+    ASSERT_EQ(found, (Path{0,1,0}));
+}
+
+TEST(TreeWalker,Cursor)
+{
+    const FileItem drive_a = MakeWalkDrive();
+    TreeWalker walker(drive_a);
+    std::vector<Path> paths;
+    while (walker.Next())
+    {
+        paths.emplace_back(walker.CurrentPath().begin(), walker.CurrentPath().end());
+        if (std::holds_alternative<const Directory*>(walker.Current()))
+            walker.Prune();
+    }
+    ASSERT_EQ(paths, (std::vector<Path>{{}, {0}, {1}}));
+    ASSERT_FALSE(walker.Next());
+}
+
+TEST(TreeWalker,DeepChain)
+{
+    // deep enough to overflow the stack if walking, counting, hashing or freeing recursed
+    constexpr int depth = 100000;
+    FileItem chain = File{"leaf"};
+    for (int i = 0; i < depth; ++i)
+        chain = Directory{"d", {chain}};
+    TreeWalker walker(chain, WalkOrder::PostOrder);
+    ASSERT_TRUE(walker.Next());
+    ASSERT_TRUE(std::holds_alternative<const File*>(walker.Current()));
+    ASSERT_EQ(walker.Depth(), depth);
+    int visited = 1;
+    while (walker.Next())
+        ++visited;
+    ASSERT_EQ(visited, depth + 1);
+    ASSERT_EQ(chain.Aggregates().depth, static_cast<std::uint32_t>(depth));
+    ASSERT_EQ(chain.Aggregates().descendants, static_cast<std::uint64_t>(depth));
+    const std::uint64_t digest = chain.Digest();
+
+    // a rename at the bottom dirties the whole spine again
+    chain[Path(depth, 0)].Rename("Leaf");
+    ASSERT_EQ(chain.Aggregates().files, 1u);
+    ASSERT_NE(chain.Digest(), digest);
+}
+
+namespace
+{
+// counts the bytes requested from the upstream of an arena
+class CountingResource : public std::pmr::memory_resource
+{
+    void* do_allocate(std::size_t bytes, std::size_t align) override { m_bytes += bytes; ++m_allocations; return std::pmr::new_delete_resource()->allocate(bytes, align); }
+    void do_deallocate(void* p, std::size_t bytes, std::size_t align) override { std::pmr::new_delete_resource()->deallocate(p, bytes, align); }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+public:
+    std::size_t m_bytes{0};
+    std::size_t m_allocations{0};
 };
 
-class ContainerFileItem
+// installs a CountingResource as the default memory resource for its lifetime
+class DefaultResourceCounter
 {
-    std::vector<FileItem>   m_contents;
+    CountingResource            m_counter;
+    std::pmr::memory_resource*  m_previous;
 public:
-    ContainerFileItem() = default;
-    ContainerFileItem(std::initializer_list<FileItem> list): m_contents(list) {}
+    DefaultResourceCounter() : m_previous(std::pmr::set_default_resource(&m_counter)) {}
+    ~DefaultResourceCounter() { std::pmr::set_default_resource(m_previous); }
+    std::size_t Allocations() const { return m_counter.m_allocations; }
+};
+}
+
+TEST(TreeArena,Construction)
+{
+    CountingResource upstream;
+    TreeArena arena(1024, &upstream);
+    {
+        auto contents = arena.MakeContents(2);
+        contents.emplace_back(Directory{"A directory name too long for SSO", {File{"A file name too long for SSO"}}, arena.Allocator()});
+        contents.emplace_back(File{"Another file name too long for SSO", arena.Allocator()});
+        FileItem drive = Drive{'a', std::move(contents)};
+        ASSERT_GT(upstream.m_bytes, 0u);
+
+        ASSERT_EQ(std::get<Drive>(drive).GetAllocator(), arena.Allocator());
+        ASSERT_EQ(std::get<Directory>(drive[Path{0}]).GetAllocator(), arena.Allocator());
+        ASSERT_EQ(std::get<File>(drive[Path{0,0}]).GetName(), "A file name too long for SSO");
+        drive[Path{1}].Rename("Renamed");
+        ASSERT_EQ(std::get<File>(drive[Path{1}]).GetName(), "Renamed");
+
+        // a plain copy leaves the arena
+        const FileItem copy = drive;
+        ASSERT_EQ(std::get<Drive>(copy).GetAllocator(), FileItem::allocator_type{});
+    }
+}
+
+TEST(TreeArena,Adopt)
+{
+    TreeArena arena;
+    const FileItem heap_tree = Drive{'a', {Directory{"Animals", {File{"Aardvark"}}}}};
+    FileItem arena_tree = arena.Adopt(heap_tree);
+    const auto& animals = std::get<Directory>(arena_tree[Path{0}]);
+    ASSERT_EQ(animals.GetAllocator(), arena.Allocator());
+    ASSERT_EQ(std::get<File>(arena_tree[Path{0,0}]).GetName(), "Aardvark");
+}
+
+TEST(NamePool,Intern)
+{
+    const File first{Interned{"index.html"}};
+    const File second{Interned{"index.html"}};
+    ASSERT_TRUE(first.IsInterned());
+    ASSERT_EQ(first.GetName(), "index.html");
+    ASSERT_EQ(first.GetName().data(), second.GetName().data());
+
+    const auto before = NamePool::Global().GetStats();
+    const File third{Interned{"index.html"}};
+    const auto after = NamePool::Global().GetStats();
+    ASSERT_EQ(before.names, after.names);
+    ASSERT_EQ(before.bytes, after.bytes);
+}
+
+TEST(NamePool,InternTree)
+{
+    FileItem drive_a = Drive{'a', {
+        Directory{"Animals", {File{"README"}}},
+        Directory{Interned{"Plants"}, {File{"README"}}}
+    }};
+    drive_a.InternNames();
+    const auto& animals_readme = std::get<File>(drive_a[Path{0,0}]);
+    const auto& plants_readme = std::get<File>(drive_a[Path{1,0}]);
+    ASSERT_TRUE(animals_readme.IsInterned());
+    ASSERT_EQ(animals_readme.GetName().data(), plants_readme.GetName().data());
+
+    drive_a[Path{0,0}].Rename("Plants");
+    ASSERT_TRUE(animals_readme.IsInterned());
+    ASSERT_EQ(animals_readme.GetName().data(), std::get<Directory>(drive_a[Path{1}]).GetName().data());
+    ASSERT_EQ(plants_readme.GetName(), "README");
+}
+
+TEST(FlatTree,Layout)
+{
+    const FileItem drive_a = MakeWalkDrive();
+    const FlatTree flat(drive_a);
+    ASSERT_EQ(flat.Size(), 6u);
+    ASSERT_EQ(flat.Root().GetKind(), NodeKind::Drive);
+    ASSERT_EQ(flat.Root().GetName(), "a");
+    ASSERT_EQ(flat.ChildCount(0), 2u);
+    ASSERT_EQ(flat.GetName(flat.Child(0, 1)), "Zebra");
+    ASSERT_EQ(flat.Parent(flat.Child(0, 1)), 0u);
+    ASSERT_THROW(flat.Child(0, 2), NonExist);
+}
+
+TEST(FlatTree,MatchesFileItem)
+{
+    FileItem drive_a = MakeWalkDrive();
+    const FlatTree flat(drive_a);
+
+    const auto crow = flat[Path{0,1,0}];
+    ASSERT_EQ(crow.GetKind(), NodeKind::File);
+    ASSERT_EQ(crow.GetName(), "Crow");
+    ASSERT_THROW((flat[Path{0,2}]), NonExist);
+    ASSERT_THROW((flat[Path{1,0}]), NonExist);
+
+    std::vector<std::pair<std::string, Path>> expected;
+    drive_a.Recurse([&expected](const auto& fi, const Path& path) { expected.emplace_back(fi.GetName(), path); });
+    std::vector<std::pair<std::string, Path>> visited;
+    flat.Recurse([&visited](FlatTree::Node node, const Path& path) { visited.emplace_back(node.GetName(), path); });
+    ASSERT_EQ(visited, expected);
+}
+
+TEST(PathCache,HitsAndMisses)
+{
+    FileItem drive_a = MakeWalkDrive();
+    PathCache cache(drive_a);
+    const Path crow_path{0,1,0};
+    const FileItem& crow = cache[crow_path];
+    ASSERT_EQ(&crow, &drive_a[crow_path]);
+    ASSERT_EQ(&cache[crow_path], &crow);
+    ASSERT_THROW((cache[Path{0,5}]), NonExist);
+    ASSERT_EQ(cache.GetStats().hits, 1u);
+    ASSERT_EQ(cache.GetStats().misses, 2u);
+
+    // renames keep positions, so the entry survives
+    cache.ResolveForWrite(Path{0,1,0}).Rename("Raven");
+    ASSERT_EQ(std::get<File>(cache[Path{0,1,0}]).GetName(), "Raven");
+    ASSERT_EQ(cache.GetStats().hits, 2u);
+    ASSERT_EQ(cache.GetStats().misses, 3u);
+}
+
+TEST(PathCache,WritesDirtyTheSpine)
+{
+    FileItem drive_a = MakeWalkDrive();
+    PathCache cache(drive_a);
+    const std::uint64_t before = drive_a.Digest();
+    cache[Path{0,0}];
+    cache.ResolveForWrite(Path{0,0}).Rename("renamed");
+    FileItem expected = MakeWalkDrive();
+    expected[Path{0,0}].Rename("renamed");
+    ASSERT_NE(drive_a.Digest(), before);
+    ASSERT_EQ(drive_a.Digest(), expected.Digest());
+    ASSERT_EQ(drive_a.Find("a:/Animals/renamed"), &drive_a[(Path{0,0})]);
+}
+
+TEST(PathCache,InvalidatedByStructuralChange)
+{
+    FileItem drive_a = MakeWalkDrive();
+    PathCache cache(drive_a);
+    cache[Path{0,1,0}];
+    cache[Path{0}];
+    drive_a[Path{0}] = Directory{"Fish", {File{"Cod"}}};
+    ASSERT_EQ(std::get<File>(cache[Path{0,0}]).GetName(), "Cod");
+    ASSERT_THROW((cache[Path{0,1,0}]), NonExist);
+    ASSERT_EQ(cache.GetStats().invalidations, 1u);
+    ASSERT_EQ(cache.GetStats().hits, 0u);
+}
+
+TEST(PathCache,InvalidatedBySharing)
+{
+    FileItem drive_a = MakeWalkDrive();
+    PathCache cache(drive_a);
+    cache[Path{0,1,0}];
+    const FileItem snapshot = drive_a;
+    cache.ResolveForWrite(Path{0,1,0}).Rename("Raven");
+    ASSERT_EQ(cache.GetStats().invalidations, 1u);
+    ASSERT_EQ((drive_a[Path{0,1,0}].GetName()), "Raven");
+    ASSERT_EQ((std::as_const(snapshot)[Path{0,1,0}].GetName()), "Crow");
+}
+
+TEST(FileItem,FindByName)
+{
+    FileItem drive_a = MakeWalkDrive();
+    ASSERT_EQ(drive_a.Find("a:/Animals/Birds/Crow"), &drive_a[(Path{0,1,0})]);
+    ASSERT_EQ(drive_a.Find("a:/"), &drive_a);
+    ASSERT_EQ(drive_a.Find("Animals/Aardvark"), &drive_a[(Path{0,0})]);
+    ASSERT_EQ(drive_a.Find("b:/Animals"), nullptr);
+    ASSERT_EQ(drive_a.Find("a:/Animals/Cat"), nullptr);
+    ASSERT_EQ(drive_a.Find("a:/Zebra/Stripes"), nullptr);
+    ASSERT_THROW(drive_a["a:/Fish"], NonExist);
+
+    drive_a["a:/Animals/Aardvark"].Rename("Anteater");
+    ASSERT_EQ(drive_a.Find("a:/Animals/Aardvark"), nullptr);
+    ASSERT_EQ(drive_a["a:/Animals/Anteater"].GetName(), "Anteater");
+}
+
+TEST(FileItem,FindNamesWithColons)
+{
+    FileItem drive_a = Drive{'a', {Directory{"logs", {File{"10:00.log"}}}}};
+    ASSERT_EQ(drive_a.Find("logs/10:00.log"), &drive_a[(Path{0,0})]);
+    ASSERT_EQ(drive_a.Find("a:/logs/10:00.log"), &drive_a[(Path{0,0})]);
+    ASSERT_EQ(drive_a[Path{0}].Find("10:00.log"), &drive_a[(Path{0,0})]);
+    ASSERT_EQ(drive_a.Find("b:/logs/10:00.log"), nullptr);
+}
+
+TEST(FileItem,FindByNameIndexed)
+{
+    auto contents = std::pmr::vector<FileItem>{};
+    for (int i = 0; i < 2 * ContainerFileItem::kNameIndexThreshold; ++i)
+        contents.emplace_back(File{"file" + std::to_string(i)});
+    FileItem drive_a = Drive{'a', {Directory{"Big", std::move(contents)}}};
+    const auto& big = std::get<Directory>(drive_a[Path{0}]);
+    ASSERT_EQ(big.Find("file40"), 40);
+    ASSERT_EQ(big.Find("file99"), -1);
+
+    // the index follows renames and structural changes
+    drive_a["a:/Big/file40"].Rename("renamed");
+    ASSERT_EQ(big.Find("file40"), -1);
+    ASSERT_EQ(big.Find("renamed"), 40);
+    drive_a[Path{0,3}] = Directory{"file40"};
+    ASSERT_EQ(big.Find("file40"), 3);
+    ASSERT_EQ(drive_a.Find("a:/Big/file40"), &drive_a[(Path{0,3})]);
+}
+
+TEST(FileItem,FindAfterAssigningOverAChild)
+{
+    FileItem drive_a = Drive{'a'};
+    auto& drive = std::get<Drive>(drive_a);
+    for (int i = 0; i < 40; ++i)
+        drive.AddChild(File{"file" + std::to_string(i)});
+    ASSERT_EQ(drive.Find("file3"), 3);
+
+    // the old name's storage is freed by the assignment; the index must not still use it
+    std::get<File>(drive_a[Path{3}]) = File{"completely_different_long_name_here"};
+    ASSERT_EQ(std::as_const(drive).Find("file3"), -1);
+    ASSERT_EQ(std::as_const(drive).Find("completely_different_long_name_here"), 3);
+
+    // appends extend the index rather than dropping it
+    drive.AddChild(File{"file3"});
+    ASSERT_EQ(std::as_const(drive).Find("file3"), 40);
+    drive.AddChild(File{"file3"});
+    ASSERT_EQ(std::as_const(drive).Find("file3"), 40);
 
-    template<class Fn>
-    void Visit(Fn&& fn)
+    // nor may it after a rename through a reference kept from before the index was built
+    FileItem& kept = drive_a[Path{3}];
+    ASSERT_EQ(std::as_const(drive).Find("completely_different_long_name_here"), 3);
+    kept.Rename("short");
+    ASSERT_EQ(std::as_const(drive).Find("completely_different_long_name_here"), -1);
+    // the next write access to the drive brings the index up to date
+    drive_a[Path{3}];
+    ASSERT_EQ(drive_a.Find("a:/short"), &kept);
+}
+
+namespace
+{
+FileItem MakeParallelDrive()
+{
+    auto top = std::pmr::vector<FileItem>{};
+    for (int d = 0; d < 20; ++d)
     {
-        for (auto& c:m_contents) fn(c);
+        auto files = std::pmr::vector<FileItem>{};
+        for (int f = 0; f < d * 5; ++f)
+            files.emplace_back(File{"file" + std::to_string(f)});
+        top.emplace_back(Directory{"dir" + std::to_string(d), std::move(files)});
     }
-    template<class Fn>
-    void Visit(Fn&& fn) const
+    return Drive{'a', std::move(top)};
+}
+}
+
+TEST(ParallelRecurse,VisitsEveryNodeOnce)
+{
+    const FileItem drive_a = MakeParallelDrive();
+    std::vector<std::pair<Path, std::string>> expected;
+    drive_a.Recurse([&expected](const auto& fi, const Path& path) { expected.emplace_back(path, fi.GetName()); });
+    std::sort(expected.begin(), expected.end());
+
+    using Visited = std::vector<std::pair<Path, std::string>>;
+    for (const int grain : {1, 8, 1000})
     {
-        for (const auto& c:m_contents) fn(c);
+        Visited visited = ParallelReduce(drive_a, Visited{},
+            [](Visited& local, const auto& fi, const Path& path) { local.emplace_back(path, fi.GetName()); },
+            [](Visited all, const Visited& local) { all.insert(all.end(), local.begin(), local.end()); return all; },
+            ParallelOptions{grain, 2});
+        std::sort(visited.begin(), visited.end());
+        ASSERT_EQ(visited, expected);
     }
-    FileItem& Get(int idx) { if(idx<0 || idx>=(int)m_contents.size()) throw NonExist{}; return m_contents[idx];}
-};
+}
 
-class Drive : public ContainerFileItem
+TEST(ParallelRecurse,Count)
 {
-    char                    m_drive_letter{'a'};
-public:
-    Drive(char id) : m_drive_letter(id) {}
-    Drive(char id, std::initializer_list<FileItem> contents) 
-        : m_drive_letter(id)
-        , ContainerFileItem(contents)
-        {}
+    const FileItem drive_a = MakeParallelDrive();
+    std::atomic<int> files{0};
+    ParallelRecurse(drive_a, [&files](const auto& fi, const Path&) {
+        if constexpr (std::is_same_v<std::remove_cvref_t<decltype(fi)>, File>)
+            ++files;
+    }, ParallelOptions{4});
+    ASSERT_EQ(files.load(), 950);
+}
 
-    std::string_view GetName() const { return std::string_view{&m_drive_letter, 1}; }
-};
+TEST(TreePrinter,MatchesStreamOutput)
+{
+    const FileItem drive_a = MakeWalkDrive();
+    const std::string expected = "a\n\tAnimals\n\t\tAardvark\n\t\tBirds\n\t\t\tCrow\n\tZebra\n";
+    std::ostringstream os;
+    os << drive_a;
+    ASSERT_EQ(os.str(), expected);
 
+    std::string out;
+    {
+        TreePrinter printer(StringSink{out}, 8);
+        printer.Print(drive_a);
+        printer.Flush();
+        ASSERT_EQ(out, expected);
+        printer.Print(drive_a);
+    }
+    ASSERT_EQ(out, expected + expected);
+}
 
+TEST(TreePrinter,DeepIndentAndFd)
+{
+    FileItem chain = File{"leaf"};
+    for (int i = 0; i < 300; ++i)
+        chain = Directory{"d", {chain}};
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    std::FILE* read_end = fdopen(fds[0], "r");
+    {
+        TreePrinter printer(FdSink{fds[1]});
+        printer.Print(chain);
+    }
+    close(fds[1]);
+    std::string last;
+    char line[1024];
+    while (std::fgets(line, sizeof line, read_end))
+        last = line;
+    std::fclose(read_end);
+    ASSERT_EQ(last, std::string(300, '\t') + "leaf\n");
+}
 
-class Directory : public ContainerFileItem, public NamedFileItem
+TEST(TreePrinter,SinkErrorsSurfaceFromFlushOnly)
 {
-public:
-    Directory() = default;
-    Directory(std::string_view name) : NamedFileItem(name), ContainerFileItem({}) {}
-    Directory(std::string_view name, std::initializer_list<FileItem> list) : NamedFileItem(name), ContainerFileItem(list) {}
-};
+    const FileItem drive_a = MakeWalkDrive();
+    {
+        TreePrinter printer(FdSink{-1});
+        printer.Print(drive_a);
+        ASSERT_THROW(printer.Flush(), std::system_error);
+    }
+    {
+        // the destructor drops the error rather than terminating
+        TreePrinter printer(FdSink{-1});
+        printer.Print(drive_a);
+    }
+}
 
-class File : public NamedFileItem
+namespace
 {
-public:
-    using NamedFileItem::NamedFileItem;
-};
+std::string TempFileName(const char* stem)
+{
+    return (std::filesystem::temp_directory_path() / (std::string(stem) + "." + std::to_string(::getpid()))).string();
+}
+}
+
+TEST(TreeFile,RoundTrip)
+{
+    const FileItem drive_a = MakeWalkDrive();
+    const std::string filename = TempFileName("roundtrip.fitree");
+    TreeFile::Save(FlatTree(drive_a), filename);
+    {
+        const FlatTree mapped = TreeFile::Map(filename);
+        std::remove(filename.c_str());      // the mapping outlives the directory entry
+        ASSERT_EQ(mapped.Size(), 6u);
+        ASSERT_EQ((mapped[Path{0,1,0}].GetName()), "Crow");
+        ASSERT_EQ(mapped.Root().GetKind(), NodeKind::Drive);
 
+        std::ostringstream original, restored;
+        original << drive_a;
+        restored << mapped.Materialize();
+        ASSERT_EQ(restored.str(), original.str());
+    }
+}
 
-class FileItem : public FileItemVariant
+TEST(TreeFile,LoadedTreeMaterializesOnWrite)
 {
-    // dispatch
-    template<class Fn>
-    void Recurse(Fn&& fn, Path path) const
+    const std::string filename = TempFileName("loaded.fitree");
+    TreeFile::Save(FlatTree(MakeWalkDrive()), filename);
+    LoadedTree loaded = LoadedTree::Open(filename);
+    std::remove(filename.c_str());
+    ASSERT_EQ(loaded.GetName(Path{0,0}), "Aardvark");
+    ASSERT_EQ(loaded.ChildCount(Path{0}), 2);
+    ASSERT_FALSE(loaded.IsMaterialized());
+
+    loaded.Rename(Path{0,0}, "Anteater");
+    ASSERT_TRUE(loaded.IsMaterialized());
+    ASSERT_EQ(loaded.GetName(Path{0,0}), "Anteater");
+    ASSERT_EQ((loaded.View()[Path{0,0}].GetName()), "Aardvark");
+    ASSERT_THROW((loaded.Mutable()[Path{0,5}]), NonExist);
+}
+
+TEST(TreeFile,RejectsBadFiles)
+{
+    const std::string filename = TempFileName("bad.fitree");
+    ASSERT_THROW(TreeFile::Map(filename), BadTreeFile);
     {
-        const auto as_variant = static_cast<const FileItemVariant&>(*this);
-        std::visit(
-            [this,&fn, &path](const auto& item) {
-                fn(item, path);
-                Recurse(std::forward<Fn>(fn), item, path);
-            }, as_variant);
+        std::FILE* out = std::fopen(filename.c_str(), "wb");
+        const std::string junk(256, 'x');
+        std::fwrite(junk.data(), 1, junk.size(), out);
+        std::fclose(out);
     }
-    // process
-    template<class Fn, class FileItemType>
-    void Recurse(Fn&& fn, const FileItemType& item, Path path) const
+    ASSERT_THROW(TreeFile::Map(filename), BadTreeFile);
+    TreeFile::Save(FlatTree(MakeWalkDrive()), filename);
+    ASSERT_EQ(truncate(filename.c_str(), 100), 0);
+    ASSERT_THROW(TreeFile::Map(filename), BadTreeFile);
+    std::remove(filename.c_str());
+}
+
+TEST(TreeFile,RejectsCorruptLinks)
+{
+    const std::string filename = TempFileName("corrupt.fitree");
+    const FlatTree flat(MakeWalkDrive());
+    TreeFile::Save(flat, filename);
+    std::string image;
     {
-        if constexpr (std::is_base_of_v<ContainerFileItem, FileItemType>)
+        std::ifstream in(filename, std::ios::binary);
+        image.assign(std::istreambuf_iterator<char>(in), {});
+    }
+    TreeFileHeader header;
+    std::memcpy(&header, image.data(), sizeof header);
+    // overwrites one 32-bit entry of a section, maps the result and restores the image
+    const auto rejects = [&](std::uint64_t section, std::size_t entry, std::uint32_t value) {
+        std::string corrupt = image;
+        std::memcpy(corrupt.data() + section + entry * sizeof value, &value, sizeof value);
+        {
+            std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+            out.write(corrupt.data(), static_cast<std::streamsize>(corrupt.size()));
+        }
+        try
         {
-            item.Visit([&fn, path, i=0] (const FileItem& fi) mutable
-            {
-                path.push_back(i++);
-                fi.Recurse(std::forward<Fn>(fn), path);
-                path.pop_back();
-            });
+            TreeFile::Map(filename);
         }
+        catch (const BadTreeFile&)
+        {
+            return true;
+        }
+        return false;
+    };
+    ASSERT_FALSE(rejects(header.first_child_offset, 1, flat.GetColumns().first_child[1]));
+    // a child range past the end, a child before its parent, a cycle back to the root
+    ASSERT_TRUE(rejects(header.first_child_offset, 1, 1'000'000));
+    ASSERT_TRUE(rejects(header.child_count_offset, 1, 1'000'000));
+    ASSERT_TRUE(rejects(header.first_child_offset, 1, 0));
+    ASSERT_TRUE(rejects(header.parent_offset, 3, 0));
+    // a name running past the names section, and names out of order
+    ASSERT_TRUE(rejects(header.name_offset_offset, 6, 1'000'000));
+    ASSERT_TRUE(rejects(header.name_offset_offset, 2, 0));
+    // a kind that is no alternative
+    ASSERT_TRUE(rejects(header.kind_offset, 0, 0x07070707));
+    std::remove(filename.c_str());
+}
+
+namespace
+{
+// a scratch directory tree on disk, removed on destruction
+class ScratchDirectory
+{
+    std::filesystem::path m_root;
+public:
+    ScratchDirectory() : m_root(TempFileName("scan"))
+    {
+        std::filesystem::create_directories(m_root / "Animals" / "Birds");
+        std::filesystem::create_directories(m_root / "Empty");
+        for (const char* file : {"Animals/Aardvark", "Animals/Birds/Crow", "Zebra"})
+            std::fclose(std::fopen((m_root / file).c_str(), "w"));
+        std::filesystem::create_symlink(m_root / "Animals", m_root / "Link");
+        for (int d = 0; d < 20; ++d)
+            std::filesystem::create_directories(m_root / "Many" / ("dir" + std::to_string(d)) / "leaf");
+    }
+    ~ScratchDirectory() { std::filesystem::remove_all(m_root); }
+    std::string Root() const { return m_root.string(); }
+};
+}
+
+TEST(TreeScanner,ScansDirectoryTree)
+{
+    const ScratchDirectory scratch;
+    TreeScanner scanner(scratch.Root(), 'c', ScanOptions{2, 2});
+    scanner.Start();
+    scanner.Wait();
+    ASSERT_TRUE(scanner.Done());
+    FileItem& drive = scanner.Tree();
+    ASSERT_TRUE(std::holds_alternative<File>(drive["c:/Animals/Birds/Crow"]));
+    ASSERT_TRUE(std::holds_alternative<File>(drive["c:/Zebra"]));
+    ASSERT_TRUE(std::holds_alternative<Directory>(drive["c:/Empty"]));
+    ASSERT_TRUE(std::holds_alternative<File>(drive["c:/Link"]));
+    ASSERT_TRUE(std::holds_alternative<Directory>(drive["c:/Many/dir19/leaf"]));
+    ASSERT_EQ(scanner.GetStats().errors, 0u);
+    ASSERT_EQ(scanner.GetStats().directories, 45u);
+    ASSERT_EQ(scanner.GetStats().entries, 48u);
+}
+
+TEST(TreeScanner,ReadableWhileScanning)
+{
+    const ScratchDirectory scratch;
+    // enough to still be scanning while the reader looks
+    for (int d = 0; d < 40; ++d)
+    {
+        const std::filesystem::path dir = std::filesystem::path(scratch.Root()) / "Wide" / ("dir" + std::to_string(d));
+        std::filesystem::create_directories(dir);
+        for (int f = 0; f < 40; ++f)
+            std::fclose(std::fopen((dir / ("file" + std::to_string(f))).c_str(), "w"));
     }
-    // access
-    template<class FileItemType>
-    FileItem& Get(FileItemType& fi, int idx)
+    TreeScanner scanner(scratch.Root(), 'c', ScanOptions{64, 1});
+    scanner.Start();
+    std::size_t last_seen = 0;
+    while (!scanner.Done())
     {
-        if constexpr (std::is_base_of_v<ContainerFileItem, FileItemType>)
-            return fi.Get(idx);
-        else
-            throw NonExist{};
+        const auto [seen, snapshot] = scanner.Read([](const FileItem& root) {
+            std::size_t nodes = 0;
+            root.Recurse([&nodes](const auto&, const Path&) { ++nodes; });
+            // the cached counts are filled as the scan goes and must keep up with it
+            EXPECT_EQ(root.Aggregates().descendants + 1, nodes);
+            return std::pair{nodes, root};
+        });
+        ASSERT_GE(seen, last_seen);
+        last_seen = seen;
+        std::size_t kept = 0;
+        snapshot.Recurse([&kept](const auto&, const Path&) { ++kept; });
+        ASSERT_EQ(kept, seen);
+        // let the scan take the lock between reads
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
     }
-    // operations
-    template<class FileItemType>
-    void Rename(FileItemType& fi, std::string_view new_name)
+    scanner.Wait();
+    std::size_t nodes = 0;
+    scanner.Tree().Recurse([&nodes](const auto&, const Path&) { ++nodes; });
+    ASSERT_EQ(scanner.Tree().Aggregates().descendants + 1, nodes);
+    ASSERT_EQ(scanner.Read([](const FileItem& root) { return root.Find("c:/Many/dir3/leaf") != nullptr; }), true);
+}
+
+TEST(TreeScanner,MissingRoot)
+{
+    TreeScanner scanner(TempFileName("does-not-exist"));
+    scanner.Start();
+    scanner.Wait();
+    ASSERT_EQ(scanner.GetStats().errors, 1u);
+    ASSERT_EQ(std::get<Drive>(scanner.Tree()).Size(), 0);
+}
+
+TEST(FileItem,MoveConstructionDoesNotCopy)
+{
+    // names are too long for SSO, so each string is exactly one allocation, and each
+    // non-empty container two (its shared block and its vector): 4 names + 3 containers;
+    // the compact layout keeps names in the NamePool instead
+    constexpr std::size_t minimal = kCompactNodes ? 6 : 10;
     {
-        if constexpr (std::is_base_of_v<NamedFileItem, FileItemType>)
-            fi.SetName(new_name);
+        DefaultResourceCounter counter;
+        FileItem drive_a = Drive{'a',
+            Directory{"Animals with a long name",
+                Directory{"Birds with a long name", File{"Crow with a long name"}},
+                File{"Aardvark with a long name"}}};
+        ASSERT_EQ(counter.Allocations(), minimal);
+        ASSERT_EQ(drive_a["a:/Animals with a long name/Birds with a long name/Crow with a long name"].GetName(), "Crow with a long name");
+    }
+    {
+        DefaultResourceCounter counter;
+        FileItem drive_a = Drive{'a', {
+            Directory{"Animals with a long name", {
+                Directory{"Birds with a long name", {File{"Crow with a long name"}}},
+                File{"Aardvark with a long name"}}}}};
+        // the initializer_list path copies every subtree once per level, which costs the names
+        // again unless they are pooled
+        if (kCompactNodes)
+            ASSERT_EQ(counter.Allocations(), minimal);
         else
-            throw CannotRename{};
+            ASSERT_GT(counter.Allocations(), minimal);
     }
-public:
-    using FileItemVariant::FileItemVariant;
- 
-    template<class Fn>
-    void Recurse(Fn&& fn) const
+}
+
+TEST(FileItem,AddChildAndEmplace)
+{
+    DefaultResourceCounter counter;
+    FileItem drive_a = Drive{'a'};
+    auto& drive = std::get<Drive>(drive_a);
+    drive.Reserve(2);
+    auto& animals = drive.Emplace<Directory>("Animals with a long name");
+    animals.AddChild(File{"Aardvark with a long name"});
+    animals.Emplace<File>("Badger with a long name");
+    FileItem plants = Directory{"Plants with a long name", File{"Fern with a long name"}};
+    const std::size_t before_move = counter.Allocations();
+    drive.AddChild(std::move(plants));
+    ASSERT_EQ(counter.Allocations(), before_move);
+    ASSERT_EQ(drive_a["a:/Animals with a long name/Badger with a long name"].GetName(), "Badger with a long name");
+    ASSERT_EQ(drive_a["a:/Plants with a long name/Fern with a long name"].GetName(), "Fern with a long name");
+    ASSERT_EQ(drive.Size(), 2);
+}
+
+TEST(FileItem,SnapshotSharesUntilWritten)
+{
+    FileItem drive_a = Drive{'a',
+        Directory{"Animals", Directory{"Birds", File{"Crow"}}, File{"Aardvark"}},
+        Directory{"Plants", File{"Fern"}}};
+    const Path crow{0,0,0};
+    const Path fern{1,0};
+    const FileItem snapshot = drive_a;
+    ASSERT_TRUE(std::get<Drive>(drive_a).IsShared());
+    // the read goes through the const overloads and copies nothing
+    ASSERT_EQ(std::as_const(drive_a)[crow].GetName(), "Crow");
+    ASSERT_TRUE(std::get<Drive>(drive_a).IsShared());
+
+    drive_a[crow].Rename("Raven");
+    ASSERT_EQ(drive_a[crow].GetName(), "Raven");
+    ASSERT_EQ(snapshot[crow].GetName(), "Crow");
+    // only the spine a: -> Animals -> Birds was copied; the siblings off it are still shared
+    ASSERT_FALSE(std::get<Drive>(drive_a).IsShared());
+    ASSERT_FALSE(std::get<Directory>(drive_a[Path{0}]).IsShared());
+    ASSERT_TRUE(std::get<Directory>(std::as_const(drive_a)[Path{1}]).IsShared());
+    ASSERT_EQ(&std::as_const(drive_a)[fern], &snapshot[fern]);
+
+    std::get<Directory>(drive_a[Path{1}]).Emplace<File>("Moss");
+    ASSERT_EQ(std::get<Directory>(drive_a[Path{1}]).Size(), 2);
+    ASSERT_EQ(std::get<Directory>(snapshot[Path{1}]).Size(), 1);
+
+    const FileItem clone = snapshot.Clone();
+    ASSERT_FALSE(std::get<Drive>(clone).IsShared());
+    ASSERT_FALSE(std::get<Directory>(clone[Path{0,0}]).IsShared());
+    ASSERT_EQ(clone[crow].GetName(), "Crow");
+}
+
+TEST(ConcurrentTree,ReadersSeeWholeVersions)
+{
+    const Path crow{0,0};
+    const Path rook{0,1};
+    ConcurrentTree tree(Drive{'a', Directory{"Birds", File{"Crow"}, File{"Rook"}}});
+    std::atomic<bool> stop{false};
+    std::atomic<int> torn{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r)
+        readers.emplace_back([&] {
+            while (!stop.load())
+                tree.Read([&](const FileItem& root) {
+                    // both names are renamed in the same update
+                    if (root[crow].GetName().size() != root[rook].GetName().size())
+                        ++torn;
+                });
+        });
+    std::string name;
+    for (int i = 0; i < 2000; ++i)
     {
-        Recurse(std::forward<Fn>(fn), Path{});
+        name.assign(1 + i % 40, 'x');
+        tree.Update([&name, &crow, &rook](FileItem& root) {
+            root[crow].Rename(name);
+            root[rook].Rename(name);
+        });
     }
-    void Rename(std::string_view new_name)
+    stop = true;
+    for (auto& reader : readers)
+        reader.join();
+    ASSERT_EQ(torn.load(), 0);
+    tree.Reclaim();
+    ASSERT_EQ(tree.PendingReclaim(), 0u);
+    ASSERT_EQ(tree.Snapshot()[crow].GetName(), name);
+}
+
+TEST(ConcurrentTree,PinnedVersionsSurvive)
+{
+    const Path crow{0,0};
+    ConcurrentTree tree(Drive{'a', Directory{"Birds", File{"Crow"}}});
+    tree.Read([&](const FileItem& pinned) {
+        tree.Rename(crow, "Rook");
+        // the version this reader holds is retired but not freed
+        ASSERT_EQ(tree.PendingReclaim(), 1u);
+        ASSERT_EQ(pinned[crow].GetName(), "Crow");
+        ASSERT_EQ(tree.Snapshot()[crow].GetName(), "Rook");
+    });
+    tree.Reclaim();
+    ASSERT_EQ(tree.PendingReclaim(), 0u);
+
+    // a failed update publishes nothing
+    ASSERT_THROW(tree.Rename(Path{0,5}, "Jay"), NonExist);
+    ASSERT_THROW(tree.Rename(Path{}, "Jay"), CannotRename);
+    ASSERT_EQ(tree.Snapshot()[crow].GetName(), "Rook");
+}
+
+TEST(TreeBatch,AppliesInOnePass)
+{
+    FileItem drive_a = MakeWalkDrive();
+    const FileItem before = drive_a;
+    TreeBatch batch;
+    batch.Rename(Path{1}, "Zebu")
+         .Insert(Path{0,1}, File{"Jay"})
+         .Rename(Path{0,1,0}, "Rook")
+         .Insert(Path{}, Directory{"Plants", File{"Fern"}})
+         .Rename(Path{0,0}, "Anteater")
+         .Insert(Path{0,1}, File{"Magpie"});
+    ASSERT_EQ(batch.Size(), 6u);
+    batch.Apply(drive_a);
+    ASSERT_TRUE(batch.Empty());
+    ASSERT_EQ(WalkNames(drive_a, WalkOrder::PreOrder),
+        (std::vector<std::string>{"a", "Animals", "Anteater", "Birds", "Rook", "Jay", "Magpie", "Zebu", "Plants", "Fern"}));
+    ASSERT_EQ(WalkNames(before, WalkOrder::PreOrder),
+        (std::vector<std::string>{"a", "Animals", "Aardvark", "Birds", "Crow", "Zebra"}));
+}
+
+TEST(TreeBatch,AllOrNothing)
+{
+    FileItem drive_a = MakeWalkDrive();
+    const auto unchanged = WalkNames(drive_a, WalkOrder::PreOrder);
+
+    TreeBatch missing;
+    missing.Rename(Path{0,0}, "Anteater").Rename(Path{0,7}, "Nothing");
+    ASSERT_THROW(missing.Apply(drive_a), NonExist);
+    ASSERT_EQ(missing.Size(), 2u);
+
+    TreeBatch drive_rename;
+    drive_rename.Rename(Path{1}, "Zebu").Rename(Path{}, "b");
+    ASSERT_THROW(drive_rename.Apply(drive_a), CannotRename);
+
+    TreeBatch into_file;
+    into_file.Rename(Path{1}, "Zebu").Insert(Path{0,0}, File{"Inside a file"});
+    ASSERT_THROW(into_file.Apply(drive_a), NonExist);
+
+    ASSERT_EQ(WalkNames(drive_a, WalkOrder::PreOrder), unchanged);
+}
+
+TEST(FileItem,TryGetAndTryRename)
+{
+    FileItem drive_a = MakeWalkDrive();
+    const FileItem& const_drive = drive_a;
+    const Path crow{0,1,0};
+    ASSERT_EQ(const_drive.TryGet(crow), &const_drive[crow]);
+    ASSERT_EQ(const_drive.TryGet(Path{0,5}), nullptr);
+    ASSERT_EQ(const_drive.TryGet(Path{1,0}), nullptr);
+    ASSERT_EQ(drive_a.TryGet(-1), nullptr);
+    ASSERT_EQ(drive_a.TryGet(Path{}), &drive_a);
+
+    ASSERT_EQ(drive_a.TryRename(crow, "Rook"), TreeStatus::Ok);
+    ASSERT_EQ(drive_a[crow].GetName(), "Rook");
+    ASSERT_EQ(drive_a.TryRename(Path{0,9}, "Jay"), TreeStatus::NonExist);
+    ASSERT_EQ(drive_a.TryRename("b"), TreeStatus::CannotRename);
+    ASSERT_EQ(drive_a.GetName(), "a");
+}
+
+TEST(FileItem,Aggregates)
+{
+    FileItem drive_a = MakeWalkDrive();
+    const auto& totals = drive_a.Aggregates();
+    ASSERT_EQ(totals.descendants, 5u);
+    ASSERT_EQ(totals.files, 3u);
+    ASSERT_EQ(totals.depth, 3u);
+    const Path crow{0,1,0};
+    ASSERT_EQ(drive_a[crow].Aggregates().descendants, 0u);
+    ASSERT_EQ(std::as_const(drive_a)[Path{0}].Aggregates().descendants, 3u);
+
+    const FileItem snapshot = drive_a;
+    auto* birds = drive_a[Path{0,1}].AsContainer();
+    birds->Emplace<Directory>("Corvids", File{"Jackdaw"}, File{"Magpie"});
+    ASSERT_EQ(drive_a.Aggregates().descendants, 8u);
+    ASSERT_EQ(drive_a.Aggregates().files, 5u);
+    ASSERT_EQ(drive_a.Aggregates().depth, 4u);
+    ASSERT_EQ(snapshot.Aggregates().descendants, 5u);
+
+    std::get<Drive>(drive_a) = Drive{'a', File{"Only"}};
+    ASSERT_EQ(drive_a.Aggregates().descendants, 1u);
+    ASSERT_EQ(drive_a.Aggregates().depth, 1u);
+
+    // matches a full walk on a generated tree, before and after a change deep inside it
+    GeneratedTree corpus = TreeGenerator{}.Make(TreeShape::Realistic, 5000);
+    const auto count = [&corpus] {
+        TreeAggregates walked;
+        Walk(corpus.tree, [&walked](const auto& fi, std::span<const int> path) {
+            walked.descendants += path.empty() ? 0 : 1;
+            walked.files += std::is_same_v<std::remove_cvref_t<decltype(fi)>, File>;
+            walked.depth = std::max<std::uint32_t>(walked.depth, path.size());
+        });
+        return walked;
+    };
+    ASSERT_EQ(corpus.tree.Aggregates().descendants, count().descendants);
+    corpus.probe.pop_back();
+    corpus.tree[corpus.probe].AsContainer()->Emplace<Directory>("added", File{"added.txt"});
+    ASSERT_EQ(corpus.tree.Aggregates().descendants, count().descendants);
+    ASSERT_EQ(corpus.tree.Aggregates().files, count().files);
+    ASSERT_EQ(corpus.tree.Aggregates().depth, count().depth);
+}
+
+TEST(FileItem,FileAttributes)
+{
+    const FileAttributes crow{1200, 1'700'000'000'000'000'000, 0100644};
+    const FileAttributes zebra{34, 1'600'000'000'000'000'000, 0100600};
+    FileItem drive_a = Drive{'a', Directory{"Birds", File{"Crow", crow}, File{"Rook"}}, File{"Zebra", zebra}};
+    ASSERT_EQ(std::get<File>(drive_a[Path{0,0}]).GetAttributes(), crow);
+    ASSERT_EQ(drive_a.Aggregates().bytes, 1234u);
+
+    const FlatTree flat(drive_a);
+    ASSERT_EQ(flat.TotalSize(), 1234u);
+    ASSERT_EQ(flat.CountModifiedAfter(1'650'000'000'000'000'000), 1u);
+    ASSERT_EQ(flat.GetAttributes(flat[Path{1}].GetIndex()), zebra);
+    ASSERT_EQ(std::get<File>(flat.Materialize()[Path{0,0}]).GetAttributes(), crow);
+
+    const std::string filename = TempFileName("attributes.fitree");
+    TreeFile::Save(flat, filename);
+    const FlatTree mapped = TreeFile::Map(filename);
+    std::remove(filename.c_str());
+    ASSERT_EQ(mapped.TotalSize(), 1234u);
+    ASSERT_TRUE(std::ranges::equal(mapped.Modes(), flat.Modes()));
+
+    std::get<File>(drive_a[Path{1}]).SetAttributes(FileAttributes{66, 0, 0});
+    ASSERT_EQ(drive_a.Aggregates().bytes, 1266u);
+}
+
+TEST(TreeScanner,RecordsFileAttributes)
+{
+    const ScratchDirectory scratch;
     {
-        auto& as_variant = static_cast<FileItemVariant&>(*this);
-        std::visit(
-            [this, new_name](auto& item) {
-                Rename(item, new_name);
-            }, as_variant);
+        std::FILE* out = std::fopen((scratch.Root() + "/Zebra").c_str(), "w");
+        std::fputs("stripes", out);
+        std::fclose(out);
+    }
+    TreeScanner scanner(scratch.Root(), 'c', ScanOptions{2, 2, true});
+    scanner.Start();
+    scanner.Wait();
+    const auto& zebra = std::get<File>(scanner.Tree()["c:/Zebra"]).GetAttributes();
+    ASSERT_EQ(zebra.size, 7u);
+    ASSERT_TRUE(S_ISREG(zebra.mode));
+    ASSERT_GT(zebra.mtime, 0);
+    ASSERT_TRUE(S_ISLNK(std::get<File>(scanner.Tree()["c:/Link"]).GetAttributes().mode));
+    ASSERT_EQ(scanner.Tree().Aggregates().bytes, 7u + std::get<File>(scanner.Tree()["c:/Link"]).GetAttributes().size);
+}
+
+TEST(NameSearch,KernelsAgreeWithWalk)
+{
+    const GeneratedTree corpus = TreeGenerator{}.Realistic(20000);
+    const FlatTree flat(corpus.tree);
+    const std::pair<NameMatch, std::string_view> queries[] = {
+        {NameMatch::Exact, "README"}, {NameMatch::Prefix, "README"}, {NameMatch::Suffix, ".md"},
+        {NameMatch::Substring, "file_19"}, {NameMatch::Substring, "e"}, {NameMatch::Substring, "not there"},
+        {NameMatch::Glob, "*.cpp"}, {NameMatch::Glob, "source_file_1?7.cpp"}, {NameMatch::Glob, "*c*e*"},
+        {NameMatch::Glob, "v1.?.0"}, {NameMatch::Glob, "*"}, {NameMatch::Glob, "???"},
+    };
+    for (const auto& [match, pattern] : queries)
+    {
+        const NameSearch search(match, pattern);
+        auto walked = search.FindPaths(corpus.tree);
+        std::ranges::sort(walked);
+        for (const NameKernel kernel : {NameKernel::Scalar, NameKernel::Vector})
+        {
+            auto found = search.FindPaths(flat, kernel);
+            std::ranges::sort(found);
+            ASSERT_EQ(found, walked) << pattern;
+        }
+        for (const Path& path : walked)
+            ASSERT_TRUE(search.Matches(corpus.tree[path].GetName())) << pattern;
     }
-    FileItem& operator[](int idx)
+}
+
+TEST(NameSearch,MatchesWithinOneName)
+{
+    // names are packed back to back, so "ab" + "cd" must not match "bc"
+    FileItem drive_a = Drive{'a', File{"ab"}, File{"cd"}, Directory{"abcd", File{"xab"}}};
+    const FlatTree flat(drive_a);
+    const Path abcd{2};
+    ASSERT_EQ(NameSearch(NameMatch::Substring, "bc").FindPaths(flat), std::vector<Path>{abcd});
+    ASSERT_EQ(NameSearch(NameMatch::Exact, "ab").Search(flat).size(), 1u);
+    ASSERT_EQ(NameSearch(NameMatch::Suffix, "ab").Search(flat).size(), 2u);
+    ASSERT_EQ(NameSearch(NameMatch::Glob, "?b*").Search(flat).size(), 2u);
+    ASSERT_EQ(flat.PathTo(flat[Path{2,0}].GetIndex()), (Path{2,0}));
+}
+
+TEST(SortedDirectory,FindsAndVisitsInNameOrder)
+{
+    Directory logs{"logs"};
+    std::vector<std::string> names;
+    for (int day = 1; day <= 28; ++day)
+        for (int part = 0; part < 20; ++part)
+            names.push_back("log-2026-10-" + std::to_string(day) + "-" + std::to_string(part));
+    std::mt19937 rng(7);
+    std::ranges::shuffle(names, rng);
+    std::size_t name_bytes = 0;
+    for (const std::string& name : names)
     {
-        auto& as_variant = static_cast<FileItemVariant&>(*this);
-        return std::visit(
-            [this, idx](auto& item)->FileItem& {
-                return Get(item, idx);
-            }, as_variant);
+        logs.Emplace<File>(name, FileAttributes{name.size(), 0, 0});
+        name_bytes += name.size();
     }
-    FileItem& operator[](const Path& path)
+
+    const SortedDirectory sorted(std::move(logs));
+    ASSERT_EQ(sorted.Size(), names.size());
+    ASSERT_LT(sorted.NameBytes(), name_bytes / 2);
+    std::ranges::sort(names);
+    std::size_t i = 0;
+    sorted.Visit([&](std::string_view name, const FileItem& child) {
+        ASSERT_EQ(name, names[i]);
+        ASSERT_EQ(std::get<File>(child).GetAttributes().size, name.size());
+        ASSERT_EQ(sorted.GetChildName(i), name);
+        ++i;
+    });
+    for (const std::string& name : names)
+        ASSERT_EQ(sorted.IndexOf(name), std::ranges::lower_bound(names, name) - names.begin());
+    ASSERT_EQ(sorted.Find("log-2026-10-1-200"), nullptr);
+    ASSERT_EQ(sorted.Find("a"), nullptr);
+    ASSERT_EQ(sorted.Find("m"), nullptr);
+
+    const Directory restored = sorted.ToDirectory();
+    ASSERT_EQ(restored.GetName(), "logs");
+    ASSERT_EQ(restored.Get(0).GetName(), names.front());
+    ASSERT_EQ(restored.Get(restored.Size() - 1).GetName(), names.back());
+}
+
+TEST(SortedDirectory,InsertAndEraseKeepOrder)
+{
+    SortedDirectory sorted("big");
+    std::multimap<std::string, int> reference;
+    std::mt19937 rng(11);
+    for (int i = 0; i < 2000; ++i)
     {
-        auto remaining = std::span<const int>(path.data(), path.size());
-        FileItem* current = this;
-        while (!remaining.empty())
+        // few distinct names, so equal names run across block boundaries
+        const std::string name = "entry-" + std::to_string(rng() % 300);
+        if (rng() % 4 == 0 && sorted.Erase(name))
         {
-            current = &(*current)[remaining[0]];
-            remaining = remaining.subspan(1);
+            reference.erase(reference.lower_bound(name));
+            continue;
         }
-        return *current;
+        sorted.Insert(name, File{"ignored", FileAttributes{static_cast<std::uint64_t>(i), 0, 0}});
+        reference.emplace(name, i);
     }
-    friend std::ostream& operator<<(std::ostream&, const FileItem&);
-};
+    ASSERT_EQ(sorted.Size(), reference.size());
+    auto expected = reference.begin();
+    sorted.Visit([&](std::string_view name, const FileItem& child) {
+        ASSERT_EQ(name, expected->first);
+        // equal names stay in insertion order
+        ASSERT_EQ(std::get<File>(child).GetAttributes().size, static_cast<std::uint64_t>(expected->second));
+        ASSERT_TRUE(child.GetName().empty());
+        ++expected;
+    });
+    ASSERT_EQ(std::get<File>(*sorted.Find("entry-42")).GetAttributes().size, static_cast<std::uint64_t>(reference.lower_bound("entry-42")->second));
+}
+
+TEST(FileItem,InsertAndRemoveChild)
+{
+    Directory birds{"Birds", File{"Crow"}, File{"Rook"}};
+    birds.InsertChild(1, File{"Jay"});
+    birds.InsertChild(3, File{"Wren"});
+    ASSERT_EQ(birds.Get(1).GetName(), "Jay");
+    ASSERT_EQ(birds.Get(3).GetName(), "Wren");
+    birds.RemoveChild(0);
+    ASSERT_EQ(birds.Size(), 3);
+    ASSERT_EQ(birds.Get(0).GetName(), "Jay");
+    ASSERT_THROW(birds.InsertChild(5, File{"Owl"}), NonExist);
+    ASSERT_THROW(birds.RemoveChild(3), NonExist);
+}
+
+TEST(NodeTable,HandlesSurviveSiblingChanges)
+{
+    FileItem drive_a = Drive{'a', Directory{"Animals", File{"Aardvark"}, Directory{"Birds", File{"Crow"}, File{"Rook"}}}, File{"Zebra"}};
+    NodeTable table(drive_a);
+    ASSERT_EQ(table.Size(), 7u);
+    const Path rook_path{0,1,1};
+    const NodeHandle rook = table.Find(rook_path);
+    const NodeHandle zebra = table.Find(Path{1});
+    const NodeHandle birds = table.Parent(rook);
+
+    table.Insert(table.Root(), File{"Ant"}, 0);
+    table.Insert(table.Find(Path{1}), File{"Adder"}, 0);
+    table.Insert(birds, File{"Jay"}, 0);
+    ASSERT_EQ(table.Resolve(rook).GetName(), "Rook");
+    ASSERT_EQ(table.PathOf(rook), (Path{1,2,2}));
+    ASSERT_EQ(&table.Resolve(rook), &drive_a[table.PathOf(rook)]);
+    ASSERT_EQ(table.Resolve(zebra).GetName(), "Zebra");
+
+    const NodeHandle crow = table.Child(birds, 1);
+    ASSERT_EQ(table.Resolve(crow).GetName(), "Crow");
+    table.Remove(crow);
+    ASSERT_FALSE(table.IsValid(crow));
+    ASSERT_EQ(table.TryResolve(crow), nullptr);
+    ASSERT_THROW(table.Resolve(crow), NonExist);
+    ASSERT_EQ(table.PathOf(rook), (Path{1,2,1}));
+
+    // the freed slot is reused under a new generation
+    const NodeHandle owl = table.Insert(birds, File{"Owl"});
+    ASSERT_EQ(owl.slot, crow.slot);
+    ASSERT_FALSE(table.IsValid(crow));
+    ASSERT_EQ(table.Resolve(owl).GetName(), "Owl");
+
+    table.Remove(table.Parent(birds));
+    ASSERT_FALSE(table.IsValid(rook));
+    ASSERT_FALSE(table.IsValid(owl));
+    ASSERT_EQ(table.Resolve(zebra).GetName(), "Zebra");
+    ASSERT_EQ(table.Size(), 3u);
+    ASSERT_THROW(table.Remove(table.Root()), NonExist);
+}
+
+TEST(NodeTable,MutableUnsharesSnapshots)
+{
+    FileItem drive_a = Drive{'a', Directory{"Birds", File{"Crow"}, File{"Rook"}}, File{"Zebra"}};
+    NodeTable table(drive_a);
+    const NodeHandle crow = table.Find(Path{0,0});
+    const NodeHandle rook = table.Find(Path{0,1});
+    ASSERT_EQ(drive_a.Aggregates().descendants, 4u);
 
-inline std::ostream& operator<<(std::ostream& os, const FileItem& item)
+    const FileItem snapshot = drive_a;
+    table.Mutable(crow).Rename("Raven");
+    ASSERT_EQ(snapshot[(Path{0,0})].GetName(), "Crow");
+    ASSERT_EQ(table.Resolve(crow).GetName(), "Raven");
+    ASSERT_EQ(&table.Resolve(rook), &drive_a[(Path{0,1})]);
+
+    table.Insert(table.Parent(crow), File{"Jay"});
+    ASSERT_EQ(drive_a.Aggregates().descendants, 5u);
+    ASSERT_EQ(snapshot.Aggregates().descendants, 4u);
+}
+
+TEST(TreeMetrics,CountsOperations)
 {
-    const auto print_fn = [&os](const auto& fi, Path path)
+    const TreeMetrics::Snapshot before = TreeMetrics::Collect();
+    FileItem drive_a = Drive{'a', Directory{"A directory with a long name", File{"Aardvark"}}, File{"Zebra"}};
+    std::size_t visited = 0;
+    drive_a.Recurse([&visited](const auto&, const Path&) { ++visited; });
+    const Path aardvark{0,0}, missing{1,0}, directory{0};
+    ASSERT_NE(drive_a.TryGet(aardvark), nullptr);
+    ASSERT_EQ(drive_a.TryGet(missing), nullptr);
+    ASSERT_EQ(drive_a.Find("a:/A directory with a long name/Cat"), nullptr);
+    drive_a[directory].Rename("Animals");
+    std::thread([] { FileItem file = File{"Crow"}; file.Rename("Rook"); }).join();
+    const TreeMetrics::Snapshot counted = TreeMetrics::Collect().Since(before);
+
+    if constexpr (!TreeMetrics::kEnabled)
     {
-        for (int ignored: path)
-            std::cout << "\t";
-        os<<fi.GetName()<<"\n";
-    };
-    item.Recurse(print_fn);
-    return os;
+        ASSERT_EQ(counted[TreeMetrics::RecurseNodes], 0u);
+        ASSERT_EQ(counted[TreeMetrics::BytesAllocated], 0u);
+        return;
+    }
+    ASSERT_EQ(counted[TreeMetrics::RecurseCalls], 1u);
+    ASSERT_EQ(counted[TreeMetrics::RecurseNodes], visited);
+    ASSERT_EQ(counted[TreeMetrics::PathLookups], 3u);
+    ASSERT_EQ(counted[TreeMetrics::PathDepth], 4u);
+    ASSERT_EQ(counted[TreeMetrics::NonExistMisses], 2u);
+    ASSERT_EQ(counted[TreeMetrics::RenameCalls], 2u);
+    ASSERT_GE(counted[TreeMetrics::BytesAllocated], std::string_view("A directory with a long name").size());
+    const std::string exported = counted.ToPrometheus();
+    ASSERT_NE(exported.find("# TYPE fileexample_rename_calls_total counter\nfileexample_rename_calls_total 2\n"), std::string::npos);
 }
 
-TEST(FileItem,Get)
+TEST(TreeDiff,ReportsAddedRemovedRenamed)
 {
-    File animal_file{"Aardvark"};
-    Directory animal_files{"Animals", 
-        {FileItem{animal_file}}
+    FileItem today = Drive{'a',
+        Directory{"Animals", File{"Aardvark"}, Directory{"Birds", File{"Crow"}, File{"Rook"}}},
+        Directory{"Plants", File{"Oak"}},
+        File{"Zebra"}};
+    const FileItem yesterday = today;
+    ASSERT_TRUE(TreeDiff(yesterday, today).Changes().empty());
+
+    today[(Path{0,1,0})].Rename("Raven");
+    today[(Path{0,1})].AsContainer()->AddChild(File{"Jay"});
+    today.AsContainer()->RemoveChild(1);
+    today[(Path{0})].Rename("Beasts");
+
+    const TreeDiff diff(yesterday, today);
+    const std::vector<TreeChange> expected{
+        {TreeChange::Kind::Renamed, {0}, {0}},
+        {TreeChange::Kind::Renamed, {0,1,0}, {0,1,0}},
+        {TreeChange::Kind::Added, {}, {0,1,2}},
+        {TreeChange::Kind::Removed, {1}, {}},
     };
-    FileItem drive_a = Drive{'a', 
-        {animal_files}
+    ASSERT_EQ(diff.Changes(), expected);
+    // the drive, Animals and Birds; Zebra is a file and Plants was removed
+    ASSERT_EQ(diff.GetStats().compared, 3u);
+}
+
+TEST(TreeDiff,CostFollowsTheChange)
+{
+    GeneratedTree corpus = TreeGenerator{}.Realistic(50000);
+    const FileItem yesterday = corpus.tree;
+    corpus.tree[corpus.probe].Rename("renamed.txt");
+    // a renamed directory is recognized by the children it still shares
+    Path project{1};
+    const std::string project_name{corpus.tree[project].GetName()};
+    corpus.tree[project].Rename("moved_project");
+
+    const TreeDiff diff(yesterday, corpus.tree);
+    const std::vector<TreeChange> expected{
+        {TreeChange::Kind::Renamed, project, project},
+        {TreeChange::Kind::Renamed, corpus.probe, corpus.probe},
     };
-    std::cout << drive_a;
-    auto dir = std::get<Directory>(drive_a[0]);
-    ASSERT_THROW(drive_a[1], NonExist);
-    ASSERT_STREQ(dir.GetName().data(), "Animals");
-    const auto file = std::get<File>(dir.Get(0));
-    ASSERT_STREQ(file.GetName().data(), "Aardvark");
+    ASSERT_EQ(diff.Changes(), expected);
+    ASSERT_LE(diff.GetStats().compared, corpus.probe.size());
+
+    // trees that share nothing are compared in full, with the same result
+    const TreeDiff full(yesterday.Clone(), corpus.tree);
+    ASSERT_EQ(full.Changes(), expected);
+    ASSERT_EQ(full.GetStats().shared, 0u);
+    ASSERT_GT(full.GetStats().compared, 1000u);
 }
 
+TEST(FileItem,DigestTracksNamesAndKinds)
+{
+    FileItem drive_a = Drive{'a', Directory{"Animals", File{"Aardvark"}, Directory{"Birds", File{"Crow"}}}, File{"Zebra"}};
+    const FileItem rebuilt = Drive{'a', Directory{"Animals", File{"Aardvark"}, Directory{"Birds", File{"Crow"}}}, File{"Zebra"}};
+    const std::uint64_t original = drive_a.Digest();
+    ASSERT_EQ(original, rebuilt.Digest());
+    ASSERT_TRUE(drive_a.AsContainer()->IsDigestCached());
 
-TEST(FileItem,GetPath)
+    const FileItem snapshot = drive_a;
+    const Path crow{0,1,0};
+    drive_a[crow].Rename("Rook");
+    ASSERT_FALSE(drive_a.AsContainer()->IsDigestCached());
+    ASSERT_NE(drive_a.Digest(), original);
+    ASSERT_EQ(snapshot.Digest(), original);
+    drive_a[crow].Rename("Crow");
+    ASSERT_EQ(drive_a.Digest(), original);
+
+    // a directory and a file of the same name differ
+    const FileItem with_file = Drive{'a', File{"Birds"}};
+    const FileItem with_directory = Drive{'a', Directory{"Birds"}};
+    ASSERT_NE(with_file.Digest(), with_directory.Digest());
+    drive_a.AsContainer()->AddChild(File{"Yak"});
+    ASSERT_NE(drive_a.Digest(), original);
+}
+
+TEST(ParallelRecurse,DigestMatchesSequential)
 {
-    File animal_file{"Aardvark"};
-    Directory animal_files{"Animals", 
-        {animal_file}
-    };
-    FileItem drive_a = Drive{'a', 
-        {animal_files}
+    const GeneratedTree corpus = TreeGenerator{}.Realistic(50000);
+    const FileItem sequential = corpus.tree.Clone();
+    ASSERT_EQ(ParallelDigest(corpus.tree, ParallelOptions{8, 4}), sequential.Digest());
+    ASSERT_TRUE(corpus.tree.AsContainer()->IsDigestCached());
+}
+
+TEST(TreeDiff,DigestsSkipEqualSubtreesOfUnsharedTrees)
+{
+    GeneratedTree corpus = TreeGenerator{}.Realistic(50000);
+    const FileItem yesterday = corpus.tree.Clone();
+    corpus.tree[corpus.probe].Rename("renamed.txt");
+    const TreeDiff diff(yesterday, corpus.tree, DiffOptions{true});
+    const std::vector<TreeChange> expected{{TreeChange::Kind::Renamed, corpus.probe, corpus.probe}};
+    ASSERT_EQ(diff.Changes(), expected);
+    ASSERT_LE(diff.GetStats().compared, corpus.probe.size());
+}
+
+TEST(TreeCoroutines,WalkGeneratorYieldsRecurseOrder)
+{
+    const GeneratedTree corpus = TreeGenerator{}.Realistic(5000);
+    std::vector<std::pair<std::string, Path>> expected, walked;
+    corpus.tree.Recurse([&expected](const auto& fi, const Path& path) { expected.emplace_back(fi.GetName(), path); });
+    for (const WalkedNode& entry : WalkGenerator(corpus.tree))
+        walked.emplace_back(entry.node.GetName(), entry.path);
+    ASSERT_EQ(walked, expected);
+
+    // the caller can stop part way
+    std::size_t taken = 0;
+    for (const WalkedNode& entry : WalkGenerator(corpus.tree))
+        if (++taken == 3 || entry.path.size() > 10)
+            break;
+    ASSERT_EQ(taken, 3u);
+    const FileItem file = File{"Aardvark"};
+    std::size_t files = 0;
+    for (const WalkedNode& entry : WalkGenerator(file))
+        files += entry.path.empty();
+    ASSERT_EQ(files, 1u);
+}
+
+namespace
+{
+// Stands in for an I/O request: resumes the visit on another thread after a delay.
+struct SimulatedIo
+{
+    std::chrono::microseconds latency;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> visit) const
+    {
+        std::thread([visit, latency = latency] {
+            std::this_thread::sleep_for(latency);
+            visit.resume();
+        }).detach();
+    }
+    void await_resume() const noexcept {}
+};
+}
+
+TEST(TreeCoroutines,WalkAsyncBoundsVisitsInFlight)
+{
+    const GeneratedTree corpus = TreeGenerator{}.Realistic(2000);
+    std::size_t nodes = 0;
+    corpus.tree.Recurse([&nodes](const auto&, const Path&) { ++nodes; });
+
+    std::mutex mutex;
+    std::vector<Path> visited;
+    std::atomic<int> in_flight{0}, most_in_flight{0};
+    WalkAsync(corpus.tree, [&](const FileItem&, Path path) -> AsyncVisit {
+        const int now = ++in_flight;
+        for (int seen = most_in_flight; now > seen && !most_in_flight.compare_exchange_weak(seen, now);)
+            ;
+        co_await SimulatedIo{std::chrono::microseconds(200)};
+        {
+            std::lock_guard lock(mutex);
+            visited.push_back(std::move(path));
+        }
+        --in_flight;
+    }, 16);
+    ASSERT_EQ(visited.size(), nodes);
+    ASSERT_LE(most_in_flight.load(), 16);
+    ASSERT_GT(most_in_flight.load(), 1);
+    std::sort(visited.begin(), visited.end());
+    ASSERT_EQ(std::adjacent_find(visited.begin(), visited.end()), visited.end());
+
+    // the first failure is rethrown once every visit has finished
+    std::atomic<std::size_t> finished{0};
+    ASSERT_THROW(WalkAsync(corpus.tree, [&finished](const FileItem& node, Path) -> AsyncVisit {
+        co_await SimulatedIo{std::chrono::microseconds(50)};
+        ++finished;
+        if (node.AsContainer() == nullptr)
+            throw NonExist{};
+    }, 8), NonExist);
+    ASSERT_EQ(finished.load(), nodes);
+
+    // so does a visitor that throws instead of returning a visit, without leaking its slot
+    finished = 0;
+    auto visit = [&finished]() -> AsyncVisit {
+        co_await SimulatedIo{std::chrono::microseconds(50)};
+        ++finished;
     };
-    const auto dir = std::get<Directory>(drive_a[Path{0}]);
-    ASSERT_STREQ(dir.GetName().data(), "Animals");
-    ASSERT_THROW(drive_a[Path{1}], NonExist);
-    const auto& file = std::get<File>(drive_a[Path{0,0}]);
-    ASSERT_STREQ(file.GetName().data(), "Aardvark");
-    ASSERT_THROW((drive_a[Path{0,1}]), NonExist);
+    std::size_t started = 0;
+    ASSERT_THROW(WalkAsync(corpus.tree, [&](const FileItem&, Path) {
+        if (++started == 100)
+            throw NonExist{};
+        return visit();
+    }, 1), NonExist);
+    ASSERT_EQ(finished.load(), 99u);
+}
 
-    drive_a[Path{0,0}].Rename("Antalope");
-    ASSERT_STREQ(file.GetName().data(), "Antalope");
+TEST(FileItem,EmptyContainersKeepTheirAllocator)
+{
+    // the compact layout has to give such containers a block to hold the allocator
+    TreeArena arena;
+    Directory empty{"Empty", arena.Allocator()};
+    ASSERT_EQ(empty.GetAllocator(), arena.Allocator());
+    ASSERT_EQ(empty.Size(), 0);
+    const Directory moved(std::move(empty), arena.Allocator());
+    ASSERT_EQ(moved.GetAllocator(), arena.Allocator());
+
+    // assignment keeps the target's allocator, whatever the source's
+    Directory assigned{"Assigned", arena.Allocator()};
+    assigned = Directory{"Heap"};
+    ASSERT_EQ(assigned.GetAllocator(), arena.Allocator());
+    assigned.AddChild(File{"Aardvark"});
+    ASSERT_EQ(assigned.GetAllocator(), arena.Allocator());
+    const Directory copy = assigned;
+    ASSERT_EQ(copy.GetAllocator(), FileItem::allocator_type{});
+    ASSERT_EQ(copy.Get(0).GetName(), "Aardvark");
+}
+
+TEST(FileItem,MoveSplicesSubtrees)
+{
+    FileItem drive_a = Drive{'a',
+        Directory{"Animals", Directory{"Birds", File{"Crow"}, File{"Rook"}}, File{"Aardvark"}},
+        Directory{"Plants", File{"Fern"}},
+        File{"README"}};
+    const FileItem snapshot = drive_a;
+    const FileItem* crow = &drive_a[Path{0,0,0}];
+
+    // the subtree moves without being copied: its nodes stay where they are
+    drive_a.Move(Path{0,0}, Path{1});
+    ASSERT_EQ(&drive_a["a:/Plants/Birds/Crow"], crow);
+    ASSERT_EQ((drive_a[Path{1,1}].GetName()), "Birds");
+    ASSERT_EQ((drive_a[Path{0}].AsContainer()->Size()), 1);
+    ASSERT_EQ((snapshot[Path{0,0}].GetName()), "Birds");
+
+    // to is numbered as before the move: Plants is still 1 while Animals loses Aardvark
+    // and positions count once the node has left
+    drive_a.Move(Path{0,0}, Path{1}, 0);
+    ASSERT_EQ((drive_a[Path{1,0}].GetName()), "Aardvark");
+    drive_a.Move(Path{2}, Path{0});
+    ASSERT_EQ(drive_a["a:/Animals/README"].GetName(), "README");
+    drive_a.Move(Path{0,0}, Path{}, 0);
+    ASSERT_EQ((drive_a[Path{0}].GetName()), "README");
+    ASSERT_EQ((drive_a[Path{2,2,1}].GetName()), "Rook");
+    drive_a.Move(Path{1}, Path{2}, 0);
+    ASSERT_EQ((drive_a[Path{1,0}].GetName()), "Animals");
+    ASSERT_EQ(drive_a.Aggregates().descendants, snapshot.Aggregates().descendants);
+
+    ASSERT_EQ(drive_a.TryMove(Path{}, Path{1}), TreeStatus::CannotMove);
+    ASSERT_EQ(drive_a.TryMove(Path{1}, Path{1,0}), TreeStatus::CannotMove);
+    ASSERT_EQ(drive_a.TryMove(Path{1}, Path{0}), TreeStatus::CannotMove);
+    ASSERT_EQ(drive_a.TryMove(Path{7}, Path{}), TreeStatus::NonExist);
+    ASSERT_EQ(drive_a.TryMove(Path{0}, Path{1}, 5), TreeStatus::NonExist);
+    ASSERT_THROW(drive_a.Move(Path{1}, Path{1,0,0}), CannotMove);
+    ASSERT_EQ(drive_a.TryMove(Path{0}, Path{1}, 2), TreeStatus::Ok);
+
+    // TakeChild and InsertChild make the same splice between any two containers
+    Directory attic{"Attic"};
+    attic.InsertChild(0, drive_a[Path{0}].AsContainer()->TakeChild(0));
+    ASSERT_EQ(attic.Get(0).GetName(), "Animals");
+    ASSERT_THROW(attic.TakeChild(1), NonExist);
+}
+
+TEST(FileItem,SortByName)
+{
+    Directory dir{"Mixed", File{"b", FileAttributes{1, 0, 0}}, Directory{"c"}, File{"a"}, File{"b", FileAttributes{2, 0, 0}}, File{"B"}};
+    ASSERT_FALSE(dir.IsSortedByName());
+    dir.SortByName();
+    ASSERT_TRUE(dir.IsSortedByName());
+    std::vector<std::string_view> names;
+    dir.Visit([&names](const FileItem& child) { names.push_back(child.GetName()); });
+    ASSERT_EQ(names, (std::vector<std::string_view>{"B", "a", "b", "b", "c"}));
+    // equal names keep their order
+    ASSERT_EQ(std::get<File>(dir.Get(2)).GetAttributes().size, 1u);
+    ASSERT_EQ(std::get<File>(dir.Get(3)).GetAttributes().size, 2u);
+
+    GeneratedTree corpus = TreeGenerator{}.Realistic(20000);
+    const FileItem snapshot = corpus.tree;
+    corpus.tree.SortByName();
+    corpus.tree.Recurse([](const auto& item, const Path&) {
+        if constexpr (std::is_base_of_v<ContainerFileItem, std::remove_cvref_t<decltype(item)>>)
+        {
+            ASSERT_TRUE(item.IsSortedByName());
+        }
+    });
+    ASSERT_EQ(corpus.tree.Aggregates().descendants, snapshot.Aggregates().descendants);
+    ASSERT_EQ(corpus.tree.Aggregates().bytes, snapshot.Aggregates().bytes);
+
+    // a sorted tree is left alone, still shared with its copy
+    const FileItem sorted = corpus.tree;
+    corpus.tree.SortByName();
+    ASSERT_TRUE(corpus.tree.AsContainer()->SharesChildrenWith(*sorted.AsContainer()));
+}
+
+TEST(ParallelRecurse,MaterializeMatchesSequential)
+{
+    const GeneratedTree corpus = TreeGenerator{}.Realistic(50000);
+    const FlatTree flat(corpus.tree);
+    const FileItem built = ParallelMaterialize(flat, ParallelOptions{8, 4});
+    ASSERT_EQ(built.Digest(), corpus.tree.Digest());
+    ASSERT_EQ(built.Aggregates().descendants, corpus.tree.Aggregates().descendants);
+    ASSERT_EQ(built.Aggregates().bytes, corpus.tree.Aggregates().bytes);
+    ASSERT_EQ(built[corpus.probe].GetName(), corpus.tree[corpus.probe].GetName());
+}
+
+TEST(ParallelRecurse,DestroyKeepsWhatSnapshotsShare)
+{
+    GeneratedTree corpus = TreeGenerator{}.Realistic(50000);
+    const std::uint64_t digest = corpus.tree.Digest();
+    const FileItem snapshot = corpus.tree;
+    corpus.tree[corpus.probe].Rename("renamed.txt");
+    ParallelDestroy(std::move(corpus.tree), ParallelOptions{8, 4});
+    ASSERT_EQ(snapshot.Clone().Digest(), digest);
+    ParallelDestroy(snapshot.Clone());
+}
+
+namespace
+{
+// records which threads return memory to it
+class FreeingThreads : public std::pmr::memory_resource
+{
+    mutable std::mutex          m_mutex;
+    std::set<std::thread::id>   m_threads;
+    void* do_allocate(std::size_t bytes, std::size_t align) override { return std::pmr::new_delete_resource()->allocate(bytes, align); }
+    void do_deallocate(void* p, std::size_t bytes, std::size_t align) override
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_threads.insert(std::this_thread::get_id());
+        }
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+public:
+    std::set<std::thread::id> Threads() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_threads;
+    }
+    void Forget()
+    {
+        std::lock_guard lock(m_mutex);
+        m_threads.clear();
+    }
+};
+}
+
+TEST(TreeReclaimer,DestroysOffTheCallingThread)
+{
+    FreeingThreads resource;
+    {
+        TreeReclaimer reclaimer;
+        std::vector<FileItem> trees;
+        for (unsigned seed = 0; seed < 4; ++seed)
+            trees.push_back(TreeGenerator{&resource}.Realistic(5000, seed).tree);
+        // building frees too
+        resource.Forget();
+        for (std::size_t i = 0; i < 3; ++i)
+            reclaimer.Retire(std::move(trees[i]));
+        reclaimer.Drain();
+        ASSERT_EQ(reclaimer.Pending(), 0u);
+        const std::set<std::thread::id> threads = resource.Threads();
+        ASSERT_FALSE(threads.empty());
+        ASSERT_EQ(threads.count(std::this_thread::get_id()), 0u);
+
+        // whatever is still queued is destroyed before the reclaimer goes
+        reclaimer.Retire(std::move(trees[3]));
+        trees.clear();
+    }
+    ASSERT_EQ(resource.Threads().count(std::this_thread::get_id()), 0u);
+}
+
+namespace
+{
+// depth directories, each holding the next and a few files, so that some levels are wider
+// than a small grain
+FileItem DeepChain(int depth)
+{
+    FileItem chain = File{"leaf"};
+    for (int i = 0; i < depth; ++i)
+        chain = i % 1000 ? Directory{"d", {chain}} : Directory{"d", {chain, File{"a"}, File{"b"}, File{"c"}}};
+    return chain;
+}
+}
+
+TEST(TreeReclaimer,DestroysDeepChains)
+{
+    constexpr int depth = 100000;
+    ParallelDestroy(DeepChain(depth));
+    ParallelDestroy(DeepChain(depth), ParallelOptions{2, 2});
+    // a chain another copy shares is only released
+    const FileItem kept = DeepChain(depth);
+    ParallelDestroy(FileItem(kept), ParallelOptions{2, 2});
+    ASSERT_EQ(kept.Aggregates().depth, static_cast<std::uint32_t>(depth));
+
+    TreeReclaimer reclaimer;
+    reclaimer.Retire(DeepChain(depth));
+    reclaimer.Drain();
+    ASSERT_EQ(reclaimer.Pending(), 0u);
+}
+
+TEST(TreeDiff,DeepChains)
+{
+    constexpr int depth = 100000;
+    const FileItem yesterday = DeepChain(depth);
+    FileItem today = DeepChain(depth);
+    today[Path(depth, 0)].Rename("Leaf");
+    const TreeDiff diff(yesterday, today);
+    const std::vector<TreeChange> expected{{TreeChange::Kind::Renamed, Path(depth, 0), Path(depth, 0)}};
+    ASSERT_EQ(diff.Changes(), expected);
+    ASSERT_EQ(diff.GetStats().compared, static_cast<std::size_t>(depth));
+}
+
+TEST(TreeDiff,MatchesMovedRenamedContainers)
+{
+    const FileItem yesterday = Drive{'a', {Directory{"Docs", {File{"a"}}}, Directory{"Music", {File{"b"}}}}};
+    FileItem today = yesterday;
+    FileItem music = today.AsContainer()->TakeChild(1);
+    music.Rename("Audio");
+    today.AsContainer()->InsertChild(0, std::move(music));
+    const std::vector<TreeChange> expected{{TreeChange::Kind::Renamed, Path{1}, Path{0}}};
+    ASSERT_EQ(TreeDiff(yesterday, today).Changes(), expected);
+
+    // unshared, the same contents are matched by digest
+    ASSERT_EQ(TreeDiff(yesterday.Clone(), today, DiffOptions{true}).Changes(), expected);
+}
+
+TEST(NodeTable,TracksDeepChains)
+{
+    constexpr int depth = 100000;
+    FileItem root = Drive{'a', {DeepChain(depth)}};
+    NodeTable table(root);
+    const std::size_t nodes = table.Size();
+    ASSERT_EQ(nodes, root.Aggregates().descendants + 1);
+    const NodeHandle deepest = table.Find(Path(depth + 1, 0));
+    ASSERT_EQ(&table.Resolve(deepest), &root[Path(depth + 1, 0)]);
+
+    const NodeHandle added = table.Insert(table.Root(), DeepChain(depth));
+    ASSERT_EQ(table.Size(), 2 * nodes - 1);
+    table.Remove(table.Child(table.Root(), 0));
+    ASSERT_FALSE(table.IsValid(deepest));
+    ASSERT_EQ(table.Size(), nodes);
+    ASSERT_EQ(table.PathOf(added), (Path{0}));
+}
+
+TEST(TreeArena,DiscardFreesInBulk)
+{
+    CountingResource upstream;
+    {
+        TreeArena arena(1024, &upstream);
+        GeneratedTree corpus = TreeGenerator{arena.Allocator()}.Realistic(20000);
+        // the name index of a large container is in the arena too
+        {
+            DefaultResourceCounter counter;
+            ASSERT_EQ(corpus.tree.AsContainer()->Find("project_7"), 7);
+            ASSERT_EQ(counter.Allocations(), 0u);
+        }
+        const FileItem snapshot = corpus.tree;
+        arena.Discard(std::move(corpus.tree));
+        ASSERT_EQ(snapshot[corpus.probe].GetName(), snapshot.Clone()[corpus.probe].GetName());
+
+        // a tree from elsewhere is destroyed as usual
+        arena.Discard(TreeGenerator{}.Realistic(100).tree);
+    }
+    ASSERT_GT(upstream.m_allocations, 0u);
+}
+
+TEST(FileItem,WritesByNameLeaveSnapshotsAlone)
+{
+    FileItem drive_a = Drive{'a', Directory{"Animals", File{"Aardvark"}, Directory{"Birds", File{"Crow"}}}};
+    const FileItem snapshot = drive_a;
+    drive_a["a:/Animals/Aardvark"].Rename("Zebra");
+    drive_a.Find("Animals/Birds/Crow")->Rename("Rook");
+    ASSERT_EQ((drive_a[Path{0,0}].GetName()), "Zebra");
+    ASSERT_EQ((drive_a[Path{0,1,0}].GetName()), "Rook");
+    ASSERT_EQ((snapshot[Path{0,0}].GetName()), "Aardvark");
+    ASSERT_EQ((snapshot[Path{0,1,0}].GetName()), "Crow");
+    ASSERT_EQ(snapshot.Find("a:/Animals/Aardvark")->GetName(), "Aardvark");
+}
+
+TEST(FileItem,WritesByNameDirtyTheSpine)
+{
+    FileItem drive_a = Drive{'a', Directory{"Animals", File{"Aardvark"}, Directory{"Birds", File{"Crow"}}}};
+    ASSERT_EQ(drive_a.Aggregates().files, 2u);
+    const std::uint64_t digest = drive_a.Digest();
+    std::get<Directory>(*drive_a.Find("a:/Animals")).AddChild(File{"Zebra"});
+    ASSERT_EQ(drive_a.Aggregates().files, 3u);
+    ASSERT_NE(drive_a.Digest(), digest);
+    std::get<Directory>(drive_a["a:/Animals/Birds"]).AddChild(File{"Rook", FileAttributes{5, 0, 0}});
+    ASSERT_EQ(drive_a.Aggregates().files, 4u);
+    ASSERT_EQ(drive_a.Aggregates().bytes, 5u);
+    ASSERT_EQ(drive_a.Aggregates().depth, 3u);
 }